@@ -1,6 +1,12 @@
 #define FALSE 0
 #define TRUE 1
 
+#if defined(_MSC_VER)
+#define CACHE_ALIGNED __declspec(align(64))
+#else
+#define CACHE_ALIGNED __attribute__((aligned(64)))
+#endif
+
 #define PI 3.14159265f
 #define TWO_PI 6.28318530f
 
@@ -16,5 +22,53 @@
 #define FOV_ANGLE (60 * (PI / 180))
 #define NUM_RAYS WINDOW_WIDTH
 
+// Eye height above the floor, halfway up the walls
+#define CAMERA_HEIGHT (TILE_SIZE / 2)
+
+// Wall textures reused for the floor and ceiling, by map content value
+#define FLOOR_TEXTURE 2
+#define CEILING_TEXTURE 3
+
+// Billboard sprites scattered over the open tiles at startup (at most 65536)
+#define NUM_SPRITES 200
+
+// Default frame rate, can be changed with --fps N (0 runs uncapped, add
+// --vsync to pace it by the display instead)
 #define FPS 30
-#define FRAME_TIME_LENGTH (1000 / FPS)
\ No newline at end of file
+
+// Simulate and cast frame N+1 on a second thread while frame N is drawn (turn
+// off with --no-pipeline)
+#define PIPELINE_FRAMES TRUE
+
+// Compile in the --trace FILE timeline recorder; off, the trace points cost nothing
+#define ENABLE_TRACING TRUE
+
+// Default phase profile file, written with the P key (.json for JSON, else CSV)
+#define PROFILE_FILE "profile.csv"
+
+// Player movement is simulated at this fixed rate, independent of rendering
+#define SIMULATION_HZ 60
+#define SIMULATION_STEP (1.0f / SIMULATION_HZ)
+#define MAX_FRAME_TIME 0.25f
+
+// 0 casts rays on one thread per CPU core, 1 casts them serially on the main thread
+#define NUM_RAYCAST_THREADS 0
+
+// How rays skip through open areas (cycle in game with E). Skipping only pays
+// off on large open maps; on small ones the extra work per step costs more
+// than the steps it saves, so it is off unless chosen.
+#define SKIP_NONE 0
+#define SKIP_DISTANCE_FIELD 1
+#define SKIP_PYRAMID 2
+#define NUM_SKIP_MODES 3
+#define EMPTY_SPACE_SKIPPING SKIP_NONE
+
+// When the player only turns, rebuild rays from the wall faces hit at the same
+// world angle instead of casting them again. Buckets must stay narrower than
+// the narrowest column, the angle between two neighbouring columns at the
+// screen edges, so no two columns share a bucket.
+#define USE_ANGULAR_RAY_CACHE TRUE
+#define RAY_CACHE_BUCKETS (16 * NUM_RAYS)
+
+// Redraw and present every frame even when the view has not changed
+#define REDRAW_UNCHANGED_FRAMES FALSE
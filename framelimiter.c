@@ -0,0 +1,76 @@
+#include <stdio.h>
+#include <SDL.h>
+#include "framelimiter.h"
+
+// SDL_Delay can oversleep by about a scheduler tick, so the last part of each
+// interval is spent spinning on the performance counter instead
+#define SPIN_MARGIN_SECONDS 0.002
+
+static Uint64 counterFrequency;
+static Uint64 frameInterval;
+static Uint64 nextFrameDeadline;
+static Uint64 lastFrameStart;
+
+static int numFrames;
+static int numMissedFrames;
+static double totalLatenessSeconds;
+static double worstLatenessSeconds;
+
+void setFrameLimiterRate(float targetFps) {
+	frameInterval = targetFps > 0 ? (Uint64)(counterFrequency / targetFps) : 0;
+	nextFrameDeadline = SDL_GetPerformanceCounter() + frameInterval;
+}
+
+void initializeFrameLimiter(float targetFps) {
+	counterFrequency = SDL_GetPerformanceFrequency();
+	lastFrameStart = SDL_GetPerformanceCounter();
+	numFrames = 0;
+	numMissedFrames = 0;
+	totalLatenessSeconds = 0;
+	worstLatenessSeconds = 0;
+	setFrameLimiterRate(targetFps);
+}
+
+float waitForNextFrame(void) {
+	Uint64 now = SDL_GetPerformanceCounter();
+
+	if (frameInterval > 0) {
+		if (now > nextFrameDeadline) {
+			// the frame's work ran past its slot, so there is nothing to wait for
+			double lateness = (double)(now - nextFrameDeadline) / counterFrequency;
+			numMissedFrames++;
+			totalLatenessSeconds += lateness;
+			if (lateness > worstLatenessSeconds) {
+				worstLatenessSeconds = lateness;
+			}
+			// start a fresh schedule rather than rushing to catch up
+			nextFrameDeadline = now;
+		}
+		else {
+			double remaining = (double)(nextFrameDeadline - now) / counterFrequency;
+			if (remaining > SPIN_MARGIN_SECONDS) {
+				SDL_Delay((Uint32)((remaining - SPIN_MARGIN_SECONDS) * 1000));
+			}
+			while ((now = SDL_GetPerformanceCounter()) < nextFrameDeadline);
+		}
+		nextFrameDeadline += frameInterval;
+	}
+
+	float perSecond = (float)((double)(now - lastFrameStart) / counterFrequency);
+	lastFrameStart = now;
+	numFrames++;
+	return perSecond;
+}
+
+void reportFrameLimiterStats(void) {
+	if (numFrames == 0) {
+		return;
+	}
+	printf("Frame limiter: %d of %d frames missed their deadline (%.1f%%)",
+		numMissedFrames, numFrames, 100.0 * numMissedFrames / numFrames);
+	if (numMissedFrames > 0) {
+		printf(", late by %.2f ms on average and %.2f ms at worst",
+			1000.0 * totalLatenessSeconds / numMissedFrames, 1000.0 * worstLatenessSeconds);
+	}
+	printf("\n");
+}
@@ -0,0 +1,16 @@
+#ifndef FRAMELIMITER_H
+#define FRAMELIMITER_H
+
+// Paces the main loop to a target frame rate using the high-resolution
+// performance counter: sleeps for most of each interval and spins for the
+// rest. A target of 0 runs uncapped.
+void initializeFrameLimiter(float targetFps);
+void setFrameLimiterRate(float targetFps);
+
+// Blocks until the next frame is due and returns the seconds since the last one
+float waitForNextFrame(void);
+
+// Prints how many frames started after their deadline and by how much
+void reportFrameLimiterStats(void);
+
+#endif
@@ -0,0 +1,294 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "graphics.h"
+#include "trace.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define TRANSPOSE_KERNEL_SIZE 8
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define TRANSPOSE_KERNEL_SIZE 4
+#else
+#define TRANSPOSE_KERNEL_SIZE 1
+#endif
+
+// The transpose walks the frame in square tiles of this many pixels, small
+// enough that a tile's source columns and destination rows stay in L1
+#define TRANSPOSE_TILE_SIZE 64
+
+uint32_t* colorBuffer = NULL;
+uint32_t* columnBuffer = NULL;
+
+static SDL_Texture* colorBufferTexture = NULL;
+
+// Polygon edges, top to bottom, and the x where each active one crosses the current row
+struct PolygonEdge {
+	float topY;
+	float bottomY;
+	float x; // at topY
+	float slope; // x per row
+};
+static struct PolygonEdge polygonEdges[MAX_POLYGON_VERTICES];
+static float edgeCrossings[MAX_POLYGON_VERTICES];
+
+int createColorBuffer(SDL_Renderer* renderer) {
+	colorBuffer = malloc(sizeof(uint32_t) * WINDOW_WIDTH * WINDOW_HEIGHT);
+	columnBuffer = malloc(sizeof(uint32_t) * WINDOW_WIDTH * WINDOW_HEIGHT);
+	if (colorBuffer == NULL || columnBuffer == NULL) {
+		fprintf(stderr, "Error allocating the color buffer.\n");
+		return FALSE;
+	}
+	colorBufferTexture = SDL_CreateTexture(
+		renderer,
+		SDL_PIXELFORMAT_ARGB8888,
+		SDL_TEXTUREACCESS_STREAMING,
+		WINDOW_WIDTH,
+		WINDOW_HEIGHT
+	);
+	if (colorBufferTexture == NULL) {
+		fprintf(stderr, "Error creating the color buffer texture: %s\n", SDL_GetError());
+		return FALSE;
+	}
+	return TRUE;
+}
+
+void destroyColorBuffer(void) {
+	if (colorBufferTexture != NULL) {
+		SDL_DestroyTexture(colorBufferTexture);
+		colorBufferTexture = NULL;
+	}
+	free(colorBuffer);
+	colorBuffer = NULL;
+	free(columnBuffer);
+	columnBuffer = NULL;
+}
+
+// Transposes the square block of TRANSPOSE_KERNEL_SIZE source rows starting at
+// source into destination; strides are in pixels
+static void transposeKernel(const uint32_t* source, int sourceStride, uint32_t* destination, int destinationStride) {
+#if TRANSPOSE_KERNEL_SIZE == 8
+	__m256i r0 = _mm256_loadu_si256((const __m256i*)(source + 0 * sourceStride));
+	__m256i r1 = _mm256_loadu_si256((const __m256i*)(source + 1 * sourceStride));
+	__m256i r2 = _mm256_loadu_si256((const __m256i*)(source + 2 * sourceStride));
+	__m256i r3 = _mm256_loadu_si256((const __m256i*)(source + 3 * sourceStride));
+	__m256i r4 = _mm256_loadu_si256((const __m256i*)(source + 4 * sourceStride));
+	__m256i r5 = _mm256_loadu_si256((const __m256i*)(source + 5 * sourceStride));
+	__m256i r6 = _mm256_loadu_si256((const __m256i*)(source + 6 * sourceStride));
+	__m256i r7 = _mm256_loadu_si256((const __m256i*)(source + 7 * sourceStride));
+
+	// interleave pairs of 32-bit lanes, then pairs of 64-bit lanes, then swap 128-bit halves
+	__m256i t0 = _mm256_unpacklo_epi32(r0, r1);
+	__m256i t1 = _mm256_unpackhi_epi32(r0, r1);
+	__m256i t2 = _mm256_unpacklo_epi32(r2, r3);
+	__m256i t3 = _mm256_unpackhi_epi32(r2, r3);
+	__m256i t4 = _mm256_unpacklo_epi32(r4, r5);
+	__m256i t5 = _mm256_unpackhi_epi32(r4, r5);
+	__m256i t6 = _mm256_unpacklo_epi32(r6, r7);
+	__m256i t7 = _mm256_unpackhi_epi32(r6, r7);
+
+	__m256i u0 = _mm256_unpacklo_epi64(t0, t2);
+	__m256i u1 = _mm256_unpackhi_epi64(t0, t2);
+	__m256i u2 = _mm256_unpacklo_epi64(t1, t3);
+	__m256i u3 = _mm256_unpackhi_epi64(t1, t3);
+	__m256i u4 = _mm256_unpacklo_epi64(t4, t6);
+	__m256i u5 = _mm256_unpackhi_epi64(t4, t6);
+	__m256i u6 = _mm256_unpacklo_epi64(t5, t7);
+	__m256i u7 = _mm256_unpackhi_epi64(t5, t7);
+
+	_mm256_storeu_si256((__m256i*)(destination + 0 * destinationStride), _mm256_permute2x128_si256(u0, u4, 0x20));
+	_mm256_storeu_si256((__m256i*)(destination + 1 * destinationStride), _mm256_permute2x128_si256(u1, u5, 0x20));
+	_mm256_storeu_si256((__m256i*)(destination + 2 * destinationStride), _mm256_permute2x128_si256(u2, u6, 0x20));
+	_mm256_storeu_si256((__m256i*)(destination + 3 * destinationStride), _mm256_permute2x128_si256(u3, u7, 0x20));
+	_mm256_storeu_si256((__m256i*)(destination + 4 * destinationStride), _mm256_permute2x128_si256(u0, u4, 0x31));
+	_mm256_storeu_si256((__m256i*)(destination + 5 * destinationStride), _mm256_permute2x128_si256(u1, u5, 0x31));
+	_mm256_storeu_si256((__m256i*)(destination + 6 * destinationStride), _mm256_permute2x128_si256(u2, u6, 0x31));
+	_mm256_storeu_si256((__m256i*)(destination + 7 * destinationStride), _mm256_permute2x128_si256(u3, u7, 0x31));
+#elif TRANSPOSE_KERNEL_SIZE == 4
+	__m128i r0 = _mm_loadu_si128((const __m128i*)(source + 0 * sourceStride));
+	__m128i r1 = _mm_loadu_si128((const __m128i*)(source + 1 * sourceStride));
+	__m128i r2 = _mm_loadu_si128((const __m128i*)(source + 2 * sourceStride));
+	__m128i r3 = _mm_loadu_si128((const __m128i*)(source + 3 * sourceStride));
+
+	__m128i t0 = _mm_unpacklo_epi32(r0, r1);
+	__m128i t1 = _mm_unpacklo_epi32(r2, r3);
+	__m128i t2 = _mm_unpackhi_epi32(r0, r1);
+	__m128i t3 = _mm_unpackhi_epi32(r2, r3);
+
+	_mm_storeu_si128((__m128i*)(destination + 0 * destinationStride), _mm_unpacklo_epi64(t0, t1));
+	_mm_storeu_si128((__m128i*)(destination + 1 * destinationStride), _mm_unpackhi_epi64(t0, t1));
+	_mm_storeu_si128((__m128i*)(destination + 2 * destinationStride), _mm_unpacklo_epi64(t2, t3));
+	_mm_storeu_si128((__m128i*)(destination + 3 * destinationStride), _mm_unpackhi_epi64(t2, t3));
+#else
+	(void)sourceStride;
+	(void)destinationStride;
+	*destination = *source;
+#endif
+}
+
+void resolveColumnBuffer(void) {
+	TRACE_BEGIN("resolveColumnBuffer");
+	int kernelWidth = WINDOW_WIDTH - WINDOW_WIDTH % TRANSPOSE_KERNEL_SIZE;
+	int kernelHeight = WINDOW_HEIGHT - WINDOW_HEIGHT % TRANSPOSE_KERNEL_SIZE;
+
+	for (int tileX = 0; tileX < kernelWidth; tileX += TRANSPOSE_TILE_SIZE) {
+		int tileEndX = SDL_min(tileX + TRANSPOSE_TILE_SIZE, kernelWidth);
+		for (int tileY = 0; tileY < kernelHeight; tileY += TRANSPOSE_TILE_SIZE) {
+			int tileEndY = SDL_min(tileY + TRANSPOSE_TILE_SIZE, kernelHeight);
+			for (int x = tileX; x < tileEndX; x += TRANSPOSE_KERNEL_SIZE) {
+				for (int y = tileY; y < tileEndY; y += TRANSPOSE_KERNEL_SIZE) {
+					transposeKernel(&columnBuffer[x * WINDOW_HEIGHT + y], WINDOW_HEIGHT,
+						&colorBuffer[y * WINDOW_WIDTH + x], WINDOW_WIDTH);
+				}
+			}
+		}
+	}
+
+	// the right and bottom edges left over when the window is not a whole number of kernels
+	for (int x = 0; x < WINDOW_WIDTH; x++) {
+		for (int y = x < kernelWidth ? kernelHeight : 0; y < WINDOW_HEIGHT; y++) {
+			colorBuffer[y * WINDOW_WIDTH + x] = columnBuffer[x * WINDOW_HEIGHT + y];
+		}
+	}
+	TRACE_END("resolveColumnBuffer");
+}
+
+void drawRect(int x, int y, int width, int height, uint32_t color) {
+	int minX = SDL_max(x, 0);
+	int minY = SDL_max(y, 0);
+	int maxX = SDL_min(x + width, WINDOW_WIDTH);
+	int maxY = SDL_min(y + height, WINDOW_HEIGHT);
+	for (int row = minY; row < maxY; row++) {
+		uint32_t* pixel = &colorBuffer[row * WINDOW_WIDTH];
+		for (int col = minX; col < maxX; col++) {
+			pixel[col] = color;
+		}
+	}
+}
+
+// Bresenham: integer steps along the line, one pixel per step on the longer axis
+void drawLine(int x0, int y0, int x1, int y1, uint32_t color) {
+	int deltaX = abs(x1 - x0);
+	int deltaY = -abs(y1 - y0);
+	int stepX = x0 < x1 ? 1 : -1;
+	int stepY = y0 < y1 ? 1 : -1;
+	int error = deltaX + deltaY;
+	for (;;) {
+		drawPixel(x0, y0, color);
+		if (x0 == x1 && y0 == y1) {
+			break;
+		}
+		int doubledError = 2 * error;
+		if (doubledError >= deltaY) {
+			error += deltaY;
+			x0 += stepX;
+		}
+		if (doubledError <= deltaX) {
+			error += deltaX;
+			y0 += stepY;
+		}
+	}
+}
+
+// Scanline fill: edges sorted by their top row become active as the scan
+// reaches them, so each row only intersects the edges that span it
+void fillPolygon(const float* xs, const float* ys, int count, uint32_t color) {
+	int numEdges = 0;
+	for (int i = 0; i < count; i++) {
+		int next = (i + 1) % count;
+		if (ys[i] == ys[next]) {
+			continue; // horizontal edges never cross a row center
+		}
+		int isDownward = ys[i] < ys[next];
+		struct PolygonEdge edge;
+		edge.topY = isDownward ? ys[i] : ys[next];
+		edge.bottomY = isDownward ? ys[next] : ys[i];
+		edge.x = isDownward ? xs[i] : xs[next];
+		edge.slope = (xs[next] - xs[i]) / (ys[next] - ys[i]);
+
+		// insertion sort by top, edges of a fan mostly arrive in order already
+		int j = numEdges++;
+		while (j > 0 && polygonEdges[j - 1].topY > edge.topY) {
+			polygonEdges[j] = polygonEdges[j - 1];
+			j--;
+		}
+		polygonEdges[j] = edge;
+	}
+	if (numEdges == 0) {
+		return;
+	}
+
+	float bottom = 0;
+	for (int i = 0; i < numEdges; i++) {
+		bottom = SDL_max(bottom, polygonEdges[i].bottomY);
+	}
+	int firstRow = SDL_max((int)ceilf(polygonEdges[0].topY - 0.5f), 0);
+	int endRow = SDL_min((int)ceilf(bottom - 0.5f), WINDOW_HEIGHT);
+
+	// edges before firstActive lie entirely above the current row
+	int firstActive = 0;
+	for (int row = firstRow; row < endRow; row++) {
+		float center = row + 0.5f;
+		int numCrossings = 0;
+		for (int i = firstActive; i < numEdges && polygonEdges[i].topY <= center; i++) {
+			const struct PolygonEdge* edge = &polygonEdges[i];
+			if (center >= edge->bottomY) {
+				if (i == firstActive) {
+					firstActive++;
+				}
+				continue;
+			}
+			float crossing = edge->x + (center - edge->topY) * edge->slope;
+			int j = numCrossings++;
+			while (j > 0 && edgeCrossings[j - 1] > crossing) {
+				edgeCrossings[j] = edgeCrossings[j - 1];
+				j--;
+			}
+			edgeCrossings[j] = crossing;
+		}
+
+		uint32_t* pixel = &colorBuffer[row * WINDOW_WIDTH];
+		for (int i = 0; i + 1 < numCrossings; i += 2) {
+			int spanStart = SDL_max((int)ceilf(edgeCrossings[i] - 0.5f), 0);
+			int spanEnd = SDL_min((int)ceilf(edgeCrossings[i + 1] - 0.5f), WINDOW_WIDTH);
+			for (int x = spanStart; x < spanEnd; x++) {
+				pixel[x] = color;
+			}
+		}
+	}
+}
+
+void drawImage(const uint32_t* pixels, int x, int y, int width, int height) {
+	int minX = SDL_max(x, 0);
+	int minY = SDL_max(y, 0);
+	int maxX = SDL_min(x + width, WINDOW_WIDTH);
+	int maxY = SDL_min(y + height, WINDOW_HEIGHT);
+	if (minX >= maxX) {
+		return;
+	}
+	for (int row = minY; row < maxY; row++) {
+		memcpy(&colorBuffer[row * WINDOW_WIDTH + minX], &pixels[(row - y) * width + (minX - x)],
+			sizeof(uint32_t) * (maxX - minX));
+	}
+}
+
+void renderColorBuffer(SDL_Renderer* renderer) {
+	void* pixels;
+	int pitch;
+	if (SDL_LockTexture(colorBufferTexture, NULL, &pixels, &pitch) != 0) {
+		return;
+	}
+	int rowBytes = WINDOW_WIDTH * sizeof(uint32_t);
+	if (pitch == rowBytes) {
+		memcpy(pixels, colorBuffer, (size_t)rowBytes * WINDOW_HEIGHT);
+	}
+	else {
+		for (int row = 0; row < WINDOW_HEIGHT; row++) {
+			memcpy((uint8_t*)pixels + row * pitch, &colorBuffer[row * WINDOW_WIDTH], rowBytes);
+		}
+	}
+	SDL_UnlockTexture(colorBufferTexture);
+	SDL_RenderCopy(renderer, colorBufferTexture, NULL, NULL);
+}
@@ -0,0 +1,44 @@
+#ifndef GRAPHICS_H
+#define GRAPHICS_H
+
+#include <stdint.h>
+#include <SDL.h>
+#include "constants.h"
+
+// Software framebuffer: everything is drawn into colorBuffer on the CPU and
+// uploaded once per frame through a streaming texture. Pixels are ARGB8888,
+// row-major, WINDOW_WIDTH wide.
+extern uint32_t* colorBuffer;
+
+// Column-major scratch target for passes that draw vertical strips: column x
+// is WINDOW_HEIGHT contiguous pixels starting at columnBuffer + x * WINDOW_HEIGHT,
+// so a strip stays within a few cache lines instead of touching one per row.
+// resolveColumnBuffer transposes it over the whole of colorBuffer.
+extern uint32_t* columnBuffer;
+
+int createColorBuffer(SDL_Renderer* renderer);
+void destroyColorBuffer(void);
+void resolveColumnBuffer(void);
+
+// Shapes are clipped to the window
+void drawRect(int x, int y, int width, int height, uint32_t color);
+void drawLine(int x0, int y0, int x1, int y1, uint32_t color);
+
+// Fills the pixels whose centers lie inside the polygon (even-odd rule).
+// Vertices are in pixels, at most MAX_POLYGON_VERTICES of them.
+#define MAX_POLYGON_VERTICES (NUM_RAYS + 1)
+void fillPolygon(const float* xs, const float* ys, int count, uint32_t color);
+
+// Copies a row-major image of width x height pixels with its top left corner at (x, y)
+void drawImage(const uint32_t* pixels, int x, int y, int width, int height);
+
+// Copies colorBuffer into the texture and the texture onto the render target
+void renderColorBuffer(SDL_Renderer* renderer);
+
+static inline void drawPixel(int x, int y, uint32_t color) {
+	if (x >= 0 && x < WINDOW_WIDTH && y >= 0 && y < WINDOW_HEIGHT) {
+		colorBuffer[y * WINDOW_WIDTH + x] = color;
+	}
+}
+
+#endif
@@ -1,23 +1,35 @@
 #include <stdio.h>
-#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <math.h>
 #include <SDL.h>
 #include "constants.h"
+#include "threadpool.h"
+#include "framelimiter.h"
+#include "profiler.h"
+#include "trace.h"
+#include "ray.h"
+#include "map.h"
+#include "graphics.h"
+#include "textures.h"
+#include "sprites.h"
 
-const int map[MAP_NUM_ROWS][MAP_NUM_COLS] = {
-	{1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1},
-	{1,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,1},
-	{1,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,1},
-	{1,0,0,0,1,0,1,0,1,0,1,0,1,0,1,0,1,0,0,1},
-	{1,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,1},
-	{1,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,1,0,0,1},
-	{1,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,1,0,0,1},
-	{1,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,1,0,0,1},
-	{1,0,0,0,0,0,0,0,0,0,0,0,0,1,1,1,1,0,0,1},
-	{1,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,1},
-	{1,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,1},
-	{1,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,1},
-	{1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1}
-};
+// Ray packets: adjacent columns are cast together, one per vector lane
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define RAY_PACKET_SIZE 8
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define RAY_PACKET_SIZE 4
+#else
+#define RAY_PACKET_SIZE 1
+#endif
+
+// Worker chunks start on a multiple of this many strips, which keeps every
+// chunk a whole number of ray packets and of 64-byte cache lines in each of
+// the ray buffer arrays, down to the byte-sized ones
+#define RAY_CHUNK_ALIGNMENT 64
 
 struct Player {
 	float x;
@@ -29,27 +41,182 @@ struct Player {
 	float rotationAngle;
 	float walkSpeed;
 	float turnSpeed;
-} player;
+} player, previousPlayer;
 
-struct Ray {
-	float rayAngle;
-	float wallHitX;
-	float wallHitY;
-	float distance;
-	int isRayFacingUp;
-	int isRayFacingDown;
-	int isRayFacingLeft;
-	int isRayFacingRight;
-	int wallHitContent;
-	int wasHitVertical;
-} rays[NUM_RAYS];
+// The view rendered this frame: the player pose interpolated between the last
+// two simulation steps, plus the vectors every ray direction is built from
+struct Camera {
+	float x;
+	float y;
+	float rotationAngle;
+	float dirX; // unit view direction
+	float dirY;
+	float planeX; // camera plane, perpendicular to dir and spanning the FOV
+	float planeY;
+} camera;
+
+// Simulation time not yet consumed by fixed steps
+float simulationAccumulator = 0;
+
+// Frames in flight: the simulation stage casts into one while the main thread
+// draws and presents the other
+struct Frame {
+	struct Camera camera;
+	struct RayBuffer rays;
+	Uint64 inputTime; // performance counter when the input behind this frame was read
+	Uint64 eventTime; // oldest key event first shown in this frame, 0 if none
+	int mapVersion; // map the rays were cast against
+};
+struct Frame frames[2];
+
+// The buffer castAllRays fills
+struct RayBuffer* rays = &frames[0].rays;
+
+// Handoff between the stages: the simulation publishes a finished frame by
+// bumping the sequence, and the frame lives in frames[sequence & 1]. The main
+// thread draws the newest published frame while the next one goes to the other.
+SDL_atomic_t publishedSequence;
+int displayedSequence = -1;
+
+// Simulation stage thread, started once per frame and waited for before the
+// next input is read, so at most one frame is ever in flight
+int isPipelined = PIPELINE_FRAMES;
+SDL_Thread* simulationThread = NULL;
+SDL_sem* simulationStart = NULL;
+SDL_sem* simulationDone = NULL;
+int isSimulationStopping = FALSE;
+float pendingFrameTime;
+Uint64 pendingInputTime;
+
+// Input to present latency of every presented frame
+double latencyTotal = 0;
+double latencyMax = 0;
+int latencyFrames = 0;
+
+// Key event to present latency, from the timestamp SDL gave each event. Only
+// the movement keys count; the oldest one not yet shown is carried until a
+// frame reflecting it is cast, or dropped if a step runs and the view holds.
+Uint64 pendingEventTime = 0;
+double eventLatencyTotal = 0;
+double eventLatencyMax = 0;
+int eventLatencyFrames = 0;
+int measuredSequence = -1;
 
 SDL_Window* window = NULL;
 SDL_Renderer* renderer = NULL; 
 
 int isGameRunning = FALSE;
 
-int ticksLastFrame;
+float targetFps = FPS;
+int useVsync = FALSE;
+
+// Where the P key writes the phase profile; --profile FILE also writes it at exit
+const char* profilePath = PROFILE_FILE;
+int isProfileWrittenAtExit = FALSE;
+
+// Timeline trace file given with --trace, NULL when not tracing
+const char* tracePath = NULL;
+
+// Pose and map version the rays were last cast for; when none of them change
+// the ray pass is skipped, and so is redrawing unless REDRAW_UNCHANGED_FRAMES
+float lastCastX, lastCastY, lastCastAngle;
+int lastCastMapVersion;
+int isViewDirty = TRUE;
+int isFrameDirty = TRUE;
+
+int numRaycastThreads = NUM_RAYCAST_THREADS;
+
+// Per-column position on the camera plane (-1 left edge, +1 right edge) and the
+// factor that normalizes dir + plane * cameraX, which is cos(rayAngle - rotationAngle)
+float rayColumnCameraX[NUM_RAYS];
+float rayColumnScale[NUM_RAYS];
+float rayColumnAngle[NUM_RAYS]; // rayAngle - rotationAngle
+
+// Projected wall height times ray distance for each column: the fisheye
+// correction cos(rayAngle - rotationAngle) is folded in, so a strip's height
+// is a single division by the distance along its ray
+float rayColumnWallScale[NUM_RAYS];
+
+// Perpendicular distance to the floor seen on each screen row below the
+// horizon; the ceiling row mirrored above it sees the same distance. Depends
+// only on the resolution, FOV and CAMERA_HEIGHT.
+#define NUM_FLOOR_ROWS (WINDOW_HEIGHT - WINDOW_HEIGHT / 2)
+float floorRowDistance[NUM_FLOOR_ROWS];
+
+// Rows of the last wall strip drawn in each column, [top, bottom); the floor
+// and ceiling fill whatever lies outside them
+int columnWallTop[NUM_RAYS];
+int columnWallBottom[NUM_RAYS];
+
+// Sprite z-buffer: depth along the view direction of the wall in each column,
+// and the farthest of it over each block of columns, so a sprite hidden
+// behind walls is rejected with a few compares instead of one per column
+#define SPRITE_CULL_BLOCK 32
+#define NUM_SPRITE_CULL_BLOCKS ((NUM_RAYS + SPRITE_CULL_BLOCK - 1) / SPRITE_CULL_BLOCK)
+float columnWallDepth[NUM_RAYS];
+float blockWallDepth[NUM_SPRITE_CULL_BLOCKS];
+
+// Sprites nearer than this are behind the camera or too close to draw
+#define SPRITE_NEAR_DEPTH 1.0f
+
+// Sort keys quantize depth over [0, SPRITE_MAX_DEPTH); farther sprites share the last key
+#define SPRITE_MAX_DEPTH (float)(TILE_SIZE * (MAP_NUM_COLS + MAP_NUM_ROWS))
+
+// Where each sprite that survived culling lands on screen this frame
+struct SpriteProjection {
+	float depth;
+	float left; // screen x of the texture's left edge
+	float size; // width and height on screen
+	int firstColumn; // opaque columns on screen, [firstColumn, endColumn)
+	int endColumn;
+} spriteProjections[NUM_SPRITES];
+
+// Depth key << 16 | sprite index of each visible sprite, and the sort's scratch space
+uint32_t visibleSprites[NUM_SPRITES];
+uint32_t visibleSpritesScratch[NUM_SPRITES];
+
+// Screen columns of the sprite being drawn that pass the depth test, and the
+// offset of the texel column each one samples
+int spriteColumnX[NUM_RAYS];
+int spriteColumnTexels[NUM_RAYS];
+
+// Outline of the minimap visibility polygon, in minimap pixels, and how far
+// off the outline a vertex may be and still be dropped as collinear
+#define VISIBILITY_TOLERANCE 0.25f
+float visibilityX[NUM_RAYS + 1];
+float visibilityY[NUM_RAYS + 1];
+
+// The minimap's tile layer, rasterized once and again only when the map
+// version a frame was cast against changes; drawing the minimap copies it
+// into the frame a row at a time
+uint32_t* minimapPixels = NULL;
+int minimapWidth;
+int minimapHeight;
+int minimapVersion;
+
+// Angular ray cache: the wall face hit by the last ray cast at each quantized
+// world angle. Entries are only valid for the epoch they were written in, and
+// the epoch changes whenever the ray origin or the map changes. Buckets are
+// narrower than the narrowest column, so no two columns share one in a frame.
+struct RayCacheEntry {
+	int cellIndex;
+	uint32_t epochAndSide; // epoch << 1 | wasHitVertical
+} rayCache[RAY_CACHE_BUCKETS];
+uint32_t rayCacheEpoch = 0;
+float rayCacheOriginX, rayCacheOriginY;
+int rayCacheMapVersion;
+int rayHitCell[NUM_RAYS]; // cell index each ray stopped in, for filling the cache
+
+// How many buckets to look either side of a ray for cached neighbors; columns
+// are at most about three buckets apart
+#define RAY_CACHE_SEARCH 4
+
+// How rays jump through empty space, and how many traversal steps they took
+// since the last report
+int emptySpaceSkipping = EMPTY_SPACE_SKIPPING;
+const char* skippingNames[NUM_SKIP_MODES] = { "off", "distance field", "occupancy pyramid" };
+SDL_atomic_t rayStepCount;
+int rayCastCount = 0;
 
 int initializeWindow() {
 	if (SDL_Init(SDL_INIT_EVERYTHING) != 0) {
@@ -70,25 +237,87 @@ int initializeWindow() {
 		return FALSE;
 	}
 
-	renderer = SDL_CreateRenderer(window, -1, 0);
+	renderer = SDL_CreateRenderer(window, -1, useVsync ? SDL_RENDERER_PRESENTVSYNC : 0);
 	if (!renderer) {
 		fprintf(stderr, "Error creating SDL renderer.\n");
 		return FALSE;
 	}
 
 	SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
+
+	if (!createColorBuffer(renderer)) {
+		return FALSE;
+	}
 	return TRUE;
 }
 
 void destroyWindow() {
+	free(minimapPixels);
+	minimapPixels = NULL;
+	destroyColorBuffer();
 	SDL_DestroyRenderer(renderer);
 	SDL_DestroyWindow(window);
 	SDL_Quit();
 }
 
+float normalizeAngle(float angle) {
+	angle = remainderf(angle, TWO_PI);
+	if (angle < 0) {
+		angle = TWO_PI + angle;
+	}
+	return angle;
+}
+
+// Only needs to run again when the number of rays or the FOV changes
+void buildRayColumnTables(int numRays) {
+	float planeLength = tanf(FOV_ANGLE / 2);
+	for (int col = 0; col < numRays; col++) {
+		float cameraX = 2.0f * col / numRays - 1.0f;
+		rayColumnCameraX[col] = cameraX;
+		rayColumnScale[col] = 1.0f / sqrtf(1.0f + cameraX * cameraX * planeLength * planeLength);
+		rayColumnAngle[col] = atanf(cameraX * planeLength);
+		rayColumnWallScale[col] = TILE_SIZE * ((WINDOW_WIDTH / 2) / planeLength) / rayColumnScale[col];
+	}
+}
+
+// Unit direction of a column's ray. Every cast path and getRayWallHit go
+// through here, so a hit point rebuilt from the distance matches the cast.
+static inline void getRayDirection(const struct Camera* view, int col, float* rayDirX, float* rayDirY) {
+	float cameraX = rayColumnCameraX[col];
+	*rayDirX = (view->dirX + view->planeX * cameraX) * rayColumnScale[col];
+	*rayDirY = (view->dirY + view->planeY * cameraX) * rayColumnScale[col];
+}
+
+void buildFloorRowTable(void) {
+	float projectionDistance = (WINDOW_WIDTH / 2) / tanf(FOV_ANGLE / 2);
+	for (int row = 0; row < NUM_FLOOR_ROWS; row++) {
+		// through the pixel center, half a row below the horizon for the first
+		float rowsBelowHorizon = WINDOW_HEIGHT / 2 + row + 0.5f - WINDOW_HEIGHT / 2.0f;
+		floorRowDistance[row] = CAMERA_HEIGHT * projectionDistance / rowsBelowHorizon;
+	}
+}
+
+// Places the camera at fraction alpha of the way from the previous simulation
+// step to the current one. The only trigonometry per frame: every ray
+// direction is built from the two vectors computed here.
+void updateCamera(float alpha) {
+	float turn = remainderf(player.rotationAngle - previousPlayer.rotationAngle, TWO_PI);
+	camera.x = previousPlayer.x + (player.x - previousPlayer.x) * alpha;
+	camera.y = previousPlayer.y + (player.y - previousPlayer.y) * alpha;
+	camera.rotationAngle = normalizeAngle(previousPlayer.rotationAngle + turn * alpha);
+
+	float planeLength = tanf(FOV_ANGLE / 2);
+	camera.dirX = cosf(camera.rotationAngle);
+	camera.dirY = sinf(camera.rotationAngle);
+	camera.planeX = -camera.dirY * planeLength;
+	camera.planeY = camera.dirX * planeLength;
+}
+
 void setup() {
 	// TODO:
 	// initialize and setup game objects
+	initializeMap();
+
 	player.x = WINDOW_WIDTH / 2;
 	player.y = WINDOW_HEIGHT / 2;
 	player.width = 5;
@@ -98,320 +327,1297 @@ void setup() {
 	player.rotationAngle = PI / 2;
 	player.walkSpeed = 100;
 	player.turnSpeed = 45 * (PI / 180);
-}
+	previousPlayer = player;
+	updateCamera(1.0f);
 
-void renderPlayer() {
-	SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
-	SDL_Rect playerRect = {
-		(int)(MINIMAP_SCALE_FACTOR * player.x),
-		(int)(MINIMAP_SCALE_FACTOR * player.y),
-		(int)(MINIMAP_SCALE_FACTOR * player.width),
-		(int)(MINIMAP_SCALE_FACTOR * player.height)
-	};
-
-	SDL_RenderFillRect(renderer, &playerRect);
+	buildRayColumnTables(NUM_RAYS);
+	buildFloorRowTable();
+	createWallTextures();
+	createSpriteTextures();
+	initializeSprites();
 
-	SDL_RenderDrawLine(
-		renderer,
-		(int)(MINIMAP_SCALE_FACTOR * player.x),
-		(int)(MINIMAP_SCALE_FACTOR * player.y),
-		(int)(MINIMAP_SCALE_FACTOR * player.x + cosf(player.rotationAngle) * 40),
-		(int)(MINIMAP_SCALE_FACTOR * player.y + sinf(player.rotationAngle) * 40)
-		);
+	initializeFrameLimiter(targetFps);
+	initializeProfiler();
 
+	if (!createThreadPool(numRaycastThreads)) {
+		fprintf(stderr, "Falling back to casting rays on the main thread.\n");
+	}
 }
 
-int mapHasWallAt(float x, float y) {
-	if (x < 0 || x > WINDOW_WIDTH || y < 0 || y > WINDOW_HEIGHT) {
-		return TRUE;
-	}
-	int mapGridIndexX = (int)(floor(x / TILE_SIZE));
-	int mapGridIndexY = (int)(floor(y / TILE_SIZE));
+void renderPlayer(const struct Frame* frame) {
+	drawRect(
+		(int)(MINIMAP_SCALE_FACTOR * frame->camera.x),
+		(int)(MINIMAP_SCALE_FACTOR * frame->camera.y),
+		(int)(MINIMAP_SCALE_FACTOR * player.width),
+		(int)(MINIMAP_SCALE_FACTOR * player.height),
+		0xFFFFFFFF
+	);
+
+	drawLine(
+		(int)(MINIMAP_SCALE_FACTOR * frame->camera.x),
+		(int)(MINIMAP_SCALE_FACTOR * frame->camera.y),
+		(int)(MINIMAP_SCALE_FACTOR * frame->camera.x + frame->camera.dirX * 40),
+		(int)(MINIMAP_SCALE_FACTOR * frame->camera.y + frame->camera.dirY * 40),
+		0xFFFFFFFF
+		);
 
-	return map[mapGridIndexY][mapGridIndexX] != 0;
 }
 
 void movePlayer(float perSecond) {
 	player.rotationAngle += player.turnDirection * player.turnSpeed * perSecond;
+	player.rotationAngle = normalizeAngle(player.rotationAngle);
 	float moveStep = player.walkDirection * player.walkSpeed * perSecond;
 
 	float newPlayerX = player.x + cosf(player.rotationAngle) * moveStep;
 	float newPlayerY = player.y + sinf(player.rotationAngle) * moveStep;
-	//TODO:
-	//perform wall collision
-	if (!mapHasWallAt(newPlayerX, newPlayerY)) {
+	if (!mapHasWallInArea(
+		fminf(player.x, newPlayerX), fminf(player.y, newPlayerY),
+		fmaxf(player.x, newPlayerX), fmaxf(player.y, newPlayerY))) {
 		player.x = newPlayerX;
 		player.y = newPlayerY;
 	}
 }
 
-float normalizeAngle(float angle) {
-	angle = remainderf(angle, TWO_PI);
-	if (angle < 0) {
-		angle = TWO_PI + angle;
+uint8_t packRayFlags(float rayDirX, float rayDirY, int wasHitVertical) {
+	return (uint8_t)(
+		(rayDirY > 0 ? RAY_FACING_DOWN : RAY_FACING_UP) |
+		(rayDirX > 0 ? RAY_FACING_RIGHT : RAY_FACING_LEFT) |
+		(wasHitVertical ? RAY_HIT_VERTICAL : 0)
+	);
+}
+
+int countActiveLanes(int laneMask) {
+	int count = 0;
+	while (laneMask) {
+		laneMask &= laneMask - 1;
+		count++;
 	}
-	return angle;
+	return count;
 }
 
-float distanceBetweenPoints(float x1, float y1, float x2, float y2) {
-	return sqrtf((x2 - x1) * (x2 - x1) + (y2 - y1) * (y2 - y1));
+// Takes every grid crossing that keeps the ray within cellsX columns and
+// cellsY rows of its current cell, in one go
+void advanceRayWithin(int cellsX, int cellsY, float* sideDistX, float* sideDistY, int* cellIndex,
+	float deltaDistX, float deltaDistY, int cellStepX, int cellStepY) {
+	float limit = fminf(*sideDistX + cellsX * deltaDistX, *sideDistY + cellsY * deltaDistY);
+	int crossingsX = SDL_min(cellsX, SDL_max(0, (int)ceilf((limit - *sideDistX) / deltaDistX)));
+	int crossingsY = SDL_min(cellsY, SDL_max(0, (int)ceilf((limit - *sideDistY) / deltaDistY)));
+
+	*sideDistX += crossingsX * deltaDistX;
+	*sideDistY += crossingsY * deltaDistY;
+	*cellIndex += crossingsX * cellStepX + crossingsY * cellStepY;
 }
 
-void castRay(float rayAngle, int stripId) {
-	//TODO: All that crazy logic for horz, vert, ...
-	rayAngle = normalizeAngle(rayAngle);
-	int isRayFacingDown = (rayAngle > 0) && (rayAngle < PI);
-	int isRayFacingUp = !isRayFacingDown;
+// Jumps over the empty space around the current cell, as far as the active
+// acceleration structure can vouch for. Returns TRUE if the ray jumped.
+int skipEmptySpace(float* sideDistX, float* sideDistY, int* cellIndex,
+	float deltaDistX, float deltaDistY, int cellStepX, int cellStepY) {
+	int cellsX, cellsY;
+	if (emptySpaceSkipping == SKIP_DISTANCE_FIELD) {
+		// every cell closer than mapDistance is empty
+		cellsX = cellsY = mapDistance[*cellIndex] - 1;
+	}
+	else {
+		// find the largest empty pyramid block around the cell and stay inside it
+		int col = *cellIndex % MAP_STRIDE;
+		int row = *cellIndex / MAP_STRIDE;
+		int level = 0;
+		while (level < mapPyramidLevels && !mapBlockHasWall(level + 1, col >> (level + 1), row >> (level + 1))) {
+			level++;
+		}
+		int blockMask = (1 << level) - 1;
+		cellsX = cellStepX > 0 ? blockMask - (col & blockMask) : (col & blockMask);
+		cellsY = cellStepY > 0 ? blockMask - (row & blockMask) : (row & blockMask);
+	}
+	if (cellsX <= 0 && cellsY <= 0) {
+		return FALSE;
+	}
 
-	int isRayFacingRight = (rayAngle <  0.5 * PI) || (rayAngle > 1.5 * PI);
-	int isRayFacingLeft = !isRayFacingRight;
+	advanceRayWithin(SDL_max(cellsX, 0), SDL_max(cellsY, 0), sideDistX, sideDistY, cellIndex,
+		deltaDistX, deltaDistY, cellStepX, cellStepY);
+	return TRUE;
+}
 
-	float xIntercept, yIntercept;
-	float xStep, yStep;
+int castRay(int stripId) {
+	float rayDirX, rayDirY;
+	getRayDirection(&camera, stripId, &rayDirX, &rayDirY);
 
 	////////////////////////////////////////////////////////////
-	// Horizontal RAY-GRID Intersection CODE
+	// DDA grid traversal
 	////////////////////////////////////////////////////////////
 
-	int foundHorizontalWallHit = FALSE;
-	float horizontalWallHitX = 0;
-	float horizontalWallHitY = 0;
-	int horizontalWallContent = 0;
+	// Integer cell the player is standing in
+	int mapX = (int)(camera.x / TILE_SIZE);
+	int mapY = (int)(camera.y / TILE_SIZE);
 
-	//Find the y-coordinate of the closest horizontal grid intersection
-	yIntercept = floorf(player.y / TILE_SIZE) * TILE_SIZE;
-	yIntercept += isRayFacingDown ? TILE_SIZE : 0;
+	// Distance along the ray to cross one whole cell in x and in y
+	float deltaDistX = rayDirX != 0 ? fabsf(TILE_SIZE / rayDirX) : FLT_MAX;
+	float deltaDistY = rayDirY != 0 ? fabsf(TILE_SIZE / rayDirY) : FLT_MAX;
 
-	//Find the x- coordinate of the closest horizontal grid intersection
-	xIntercept = player.x + (yIntercept - player.y) / tanf(rayAngle);
+	// Distance along the ray to the first vertical and horizontal grid line
+	int stepX = rayDirX > 0 ? 1 : -1;
+	int stepY = rayDirY > 0 ? 1 : -1;
+	float sideDistX = rayDirX != 0
+		? fabsf((mapX * TILE_SIZE + (stepX > 0 ? TILE_SIZE : 0) - camera.x) / rayDirX)
+		: FLT_MAX;
+	float sideDistY = rayDirY != 0
+		? fabsf((mapY * TILE_SIZE + (stepY > 0 ? TILE_SIZE : 0) - camera.y) / rayDirY)
+		: FLT_MAX;
 
-	//calculate the increment xstep and ystep
-	yStep = TILE_SIZE;
-	yStep *= isRayFacingUp ? -1 : 1;
+	// Always cross whichever grid line is closer, so both directions are
+	// walked in a single pass and no work is spent on the losing one.
+	// The map's solid border guarantees the loop ends without bounds checks.
+	int cellIndex = mapCellIndex(mapX, mapY);
+	int cellStepY = stepY * MAP_STRIDE;
+	float distance = 0;
+	int wasHitVertical = FALSE;
+	int steps = 0;
+	for (;;) {
+		if (emptySpaceSkipping != SKIP_NONE) {
+			steps += skipEmptySpace(&sideDistX, &sideDistY, &cellIndex, deltaDistX, deltaDistY, stepX, cellStepY);
+		}
 
-	xStep = TILE_SIZE / tanf(rayAngle);
-	xStep *= (isRayFacingLeft && xStep > 0) ? -1 : 1;
-	xStep *= (isRayFacingRight && xStep < 0) ? -1 : 1;
+		steps++;
+		if (sideDistX < sideDistY) {
+			distance = sideDistX;
+			sideDistX += deltaDistX;
+			cellIndex += stepX;
+			wasHitVertical = TRUE;
+		}
+		else {
+			distance = sideDistY;
+			sideDistY += deltaDistY;
+			cellIndex += cellStepY;
+			wasHitVertical = FALSE;
+		}
 
-	float nextHorizontalTouchX = xIntercept;
-	float nextHorizontalTouchY = yIntercept;
+		if (mapIsWallAtIndex(cellIndex)) {
+			break;
+		}
+	}
 
-	//Increment xStep and yStep until we find a wall
-	while (nextHorizontalTouchX >= 0 && nextHorizontalTouchX <= WINDOW_WIDTH && nextHorizontalTouchY >= 0 && nextHorizontalTouchY <= WINDOW_HEIGHT) {
-		float xToCheck = nextHorizontalTouchX;
-		float yToCheck = nextHorizontalTouchY + (isRayFacingUp ? -1 : 0);
+	// The ray direction is a unit vector, so the side distance already is
+	// the hit distance, and the hit point follows from it without a square root
+	rays->distance[stripId] = distance;
+	rays->wallHitContent[stripId] = mapContent[cellIndex];
+	rayHitCell[stripId] = cellIndex;
+	rays->flags[stripId] = packRayFlags(rayDirX, rayDirY, wasHitVertical);
+	return steps;
+}
 
-		if (mapHasWallAt(xToCheck, yToCheck)) {
-			horizontalWallHitX = nextHorizontalTouchX;
-			horizontalWallHitY = nextHorizontalTouchY;
-			horizontalWallContent = map[(int)floorf(yToCheck / TILE_SIZE)][(int)floorf(xToCheck / TILE_SIZE)];
-			foundHorizontalWallHit = TRUE;
-			break;
+#if RAY_PACKET_SIZE > 1
+int castRayPacket(int stripId) {
+	float rayDirX[RAY_PACKET_SIZE], rayDirY[RAY_PACKET_SIZE];
+	float deltaDistX[RAY_PACKET_SIZE], deltaDistY[RAY_PACKET_SIZE];
+	float sideDistX[RAY_PACKET_SIZE], sideDistY[RAY_PACKET_SIZE];
+	int cellStepX[RAY_PACKET_SIZE], cellStepY[RAY_PACKET_SIZE];
+	int cellIndex[RAY_PACKET_SIZE];
+	int wasHitVertical[RAY_PACKET_SIZE];
+	int steps = 0;
+
+	// Per-lane setup is the same as in castRay, only the traversal is vectorized
+	int cameraMapX = (int)(camera.x / TILE_SIZE);
+	int cameraMapY = (int)(camera.y / TILE_SIZE);
+	for (int lane = 0; lane < RAY_PACKET_SIZE; lane++) {
+		getRayDirection(&camera, stripId + lane, &rayDirX[lane], &rayDirY[lane]);
+		int stepX = rayDirX[lane] > 0 ? 1 : -1;
+		int stepY = rayDirY[lane] > 0 ? 1 : -1;
+		cellStepX[lane] = stepX;
+		cellStepY[lane] = stepY * MAP_STRIDE;
+		cellIndex[lane] = mapCellIndex(cameraMapX, cameraMapY);
+		deltaDistX[lane] = rayDirX[lane] != 0 ? fabsf(TILE_SIZE / rayDirX[lane]) : FLT_MAX;
+		deltaDistY[lane] = rayDirY[lane] != 0 ? fabsf(TILE_SIZE / rayDirY[lane]) : FLT_MAX;
+		sideDistX[lane] = rayDirX[lane] != 0
+			? fabsf((cameraMapX * TILE_SIZE + (stepX > 0 ? TILE_SIZE : 0) - camera.x) / rayDirX[lane])
+			: FLT_MAX;
+		sideDistY[lane] = rayDirY[lane] != 0
+			? fabsf((cameraMapY * TILE_SIZE + (stepY > 0 ? TILE_SIZE : 0) - camera.y) / rayDirY[lane])
+			: FLT_MAX;
+	}
+
+#if RAY_PACKET_SIZE == 8
+	__m256 vDeltaDistX = _mm256_loadu_ps(deltaDistX);
+	__m256 vDeltaDistY = _mm256_loadu_ps(deltaDistY);
+	__m256 vSideDistX = _mm256_loadu_ps(sideDistX);
+	__m256 vSideDistY = _mm256_loadu_ps(sideDistY);
+	__m256i vCellStepX = _mm256_loadu_si256((const __m256i*)cellStepX);
+	__m256i vCellStepY = _mm256_loadu_si256((const __m256i*)cellStepY);
+	__m256i vCellIndex = _mm256_loadu_si256((const __m256i*)cellIndex);
+	__m256 vDistance = _mm256_setzero_ps();
+	__m256 vWasHitVertical = _mm256_setzero_ps();
+	__m256i vActive = _mm256_set1_epi32(-1);
+	const __m256i vBitMask = _mm256_set1_epi32(31);
+	const __m256i vOne = _mm256_set1_epi32(1);
+	const __m256 vCellStepXf = _mm256_cvtepi32_ps(vCellStepX);
+	const __m256 vCellStepYf = _mm256_cvtepi32_ps(vCellStepY);
+
+	// Masked stepping: lanes that already hit a wall keep their result while
+	// the rest of the packet keeps walking
+	while (!_mm256_testz_si256(vActive, vActive)) {
+		if (emptySpaceSkipping == SKIP_DISTANCE_FIELD) {
+			// same as skipEmptySpace, for every active lane at once
+			__m256i cellDistance = _mm256_and_si256(_mm256_mask_i32gather_epi32(_mm256_setzero_si256(),
+				(const int*)mapDistance, vCellIndex, vActive, 1), _mm256_set1_epi32(0xFF));
+			__m256 safeCells = _mm256_cvtepi32_ps(_mm256_max_epi32(_mm256_sub_epi32(cellDistance, vOne), _mm256_setzero_si256()));
+			__m256 limit = _mm256_min_ps(
+				_mm256_add_ps(vSideDistX, _mm256_mul_ps(safeCells, vDeltaDistX)),
+				_mm256_add_ps(vSideDistY, _mm256_mul_ps(safeCells, vDeltaDistY)));
+			__m256 crossingsX = _mm256_min_ps(safeCells, _mm256_max_ps(_mm256_setzero_ps(),
+				_mm256_ceil_ps(_mm256_div_ps(_mm256_sub_ps(limit, vSideDistX), vDeltaDistX))));
+			__m256 crossingsY = _mm256_min_ps(safeCells, _mm256_max_ps(_mm256_setzero_ps(),
+				_mm256_ceil_ps(_mm256_div_ps(_mm256_sub_ps(limit, vSideDistY), vDeltaDistY))));
+
+			vSideDistX = _mm256_add_ps(vSideDistX, _mm256_mul_ps(crossingsX, vDeltaDistX));
+			vSideDistY = _mm256_add_ps(vSideDistY, _mm256_mul_ps(crossingsY, vDeltaDistY));
+			vCellIndex = _mm256_add_epi32(vCellIndex, _mm256_cvtps_epi32(_mm256_add_ps(
+				_mm256_mul_ps(crossingsX, vCellStepXf), _mm256_mul_ps(crossingsY, vCellStepYf))));
+			steps += countActiveLanes(_mm256_movemask_ps(_mm256_cmp_ps(safeCells, _mm256_setzero_ps(), _CMP_GT_OQ)));
 		}
-		else {
-			nextHorizontalTouchX += xStep;
-			nextHorizontalTouchY += yStep;
+		else if (emptySpaceSkipping != SKIP_NONE) {
+			// pyramid descent diverges per lane, so it runs lane by lane
+			int activeLanes = _mm256_movemask_ps(_mm256_castsi256_ps(vActive));
+			_mm256_storeu_ps(sideDistX, vSideDistX);
+			_mm256_storeu_ps(sideDistY, vSideDistY);
+			_mm256_storeu_si256((__m256i*)cellIndex, vCellIndex);
+			for (int lane = 0; lane < RAY_PACKET_SIZE; lane++) {
+				if (activeLanes & (1 << lane)) {
+					steps += skipEmptySpace(&sideDistX[lane], &sideDistY[lane], &cellIndex[lane],
+						deltaDistX[lane], deltaDistY[lane], cellStepX[lane], cellStepY[lane]);
+				}
+			}
+			vSideDistX = _mm256_loadu_ps(sideDistX);
+			vSideDistY = _mm256_loadu_ps(sideDistY);
+			vCellIndex = _mm256_loadu_si256((const __m256i*)cellIndex);
 		}
-	}	
 
-	////////////////////////////////////////////////////////////
-	// Vertical RAY-GRID Intersection CODE
-	////////////////////////////////////////////////////////////
-    
-	int foundVerticalWallHit = FALSE;
-	float verticalWallHitX = 0;
-	float verticalWallHitY = 0;
-	int verticalWallContent = 0;
-
-	//Find the x-coordinate of the closest horizontal grid intersection
-	xIntercept = floorf(player.x / TILE_SIZE) * TILE_SIZE;
-	xIntercept += isRayFacingRight ? TILE_SIZE : 0;
-
-	//Find the y- coordinate of the closest horizontal grid intersection
-	yIntercept = player.y + (xIntercept - player.x) * tanf(rayAngle);
-
-	//calculate the increment xstep and ystep
-	xStep = TILE_SIZE;
-	xStep *= isRayFacingLeft ? -1 : 1;
-
-	yStep = TILE_SIZE * tanf(rayAngle);
-	yStep *= (isRayFacingUp && yStep > 0) ? -1 : 1;
-	yStep *= (isRayFacingDown && yStep < 0) ? -1 : 1;
-
-	float nextVerticalTouchX = xIntercept;
-	float nextVerticalTouchY = yIntercept;
-
-	//Increment xStep and yStep until we find a wall
-	while (nextVerticalTouchX >= 0 && nextVerticalTouchX <= WINDOW_WIDTH && nextVerticalTouchY >= 0 && nextVerticalTouchY <= WINDOW_HEIGHT) {
-		float xToCheck = nextVerticalTouchX + (isRayFacingLeft ? -1 : 0);
-		float yToCheck = nextVerticalTouchY;
-
-		if (mapHasWallAt(xToCheck, yToCheck)) {
-			verticalWallHitX = nextVerticalTouchX ;
-			verticalWallHitY = nextVerticalTouchY;
-			verticalWallContent = map[(int)floor(yToCheck / TILE_SIZE)][(int)floor(xToCheck / TILE_SIZE)];
-			foundVerticalWallHit = TRUE;
-			break;
+		__m256 active = _mm256_castsi256_ps(vActive);
+		steps += countActiveLanes(_mm256_movemask_ps(active));
+		__m256 takeX = _mm256_cmp_ps(vSideDistX, vSideDistY, _CMP_LT_OQ);
+		__m256 stepXMask = _mm256_and_ps(takeX, active);
+		__m256 stepYMask = _mm256_andnot_ps(takeX, active);
+
+		vDistance = _mm256_blendv_ps(vDistance, _mm256_blendv_ps(vSideDistY, vSideDistX, takeX), active);
+		vWasHitVertical = _mm256_blendv_ps(vWasHitVertical, takeX, active);
+		vSideDistX = _mm256_add_ps(vSideDistX, _mm256_and_ps(vDeltaDistX, stepXMask));
+		vSideDistY = _mm256_add_ps(vSideDistY, _mm256_and_ps(vDeltaDistY, stepYMask));
+		vCellIndex = _mm256_add_epi32(vCellIndex, _mm256_and_si256(vCellStepX, _mm256_castps_si256(stepXMask)));
+		vCellIndex = _mm256_add_epi32(vCellIndex, _mm256_and_si256(vCellStepY, _mm256_castps_si256(stepYMask)));
+
+		// gather each lane's occupancy word and pick out its bit
+		__m256i words = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), (const int*)mapOccupancy,
+			_mm256_srli_epi32(vCellIndex, 5), vActive, 4);
+		__m256i bits = _mm256_and_si256(_mm256_srlv_epi32(words, _mm256_and_si256(vCellIndex, vBitMask)), vOne);
+		__m256i hit = _mm256_cmpeq_epi32(bits, vOne);
+		vActive = _mm256_andnot_si256(hit, vActive);
+	}
+
+	_mm256_store_ps(&rays->distance[stripId], vDistance);
+	_mm256_storeu_si256((__m256i*)wasHitVertical, _mm256_castps_si256(vWasHitVertical));
+	_mm256_storeu_si256((__m256i*)cellIndex, vCellIndex);
+#else
+	__m128 vDeltaDistX = _mm_loadu_ps(deltaDistX);
+	__m128 vDeltaDistY = _mm_loadu_ps(deltaDistY);
+	__m128 vSideDistX = _mm_loadu_ps(sideDistX);
+	__m128 vSideDistY = _mm_loadu_ps(sideDistY);
+	__m128i vCellStepX = _mm_loadu_si128((const __m128i*)cellStepX);
+	__m128i vCellStepY = _mm_loadu_si128((const __m128i*)cellStepY);
+	__m128i vCellIndex = _mm_loadu_si128((const __m128i*)cellIndex);
+	__m128 vDistance = _mm_setzero_ps();
+	__m128 vWasHitVertical = _mm_setzero_ps();
+	int activeLanes = (1 << RAY_PACKET_SIZE) - 1;
+
+	// Masked stepping: lanes that already hit a wall keep their result while
+	// the rest of the packet keeps walking
+	while (activeLanes) {
+		if (emptySpaceSkipping != SKIP_NONE) {
+			_mm_storeu_ps(sideDistX, vSideDistX);
+			_mm_storeu_ps(sideDistY, vSideDistY);
+			_mm_storeu_si128((__m128i*)cellIndex, vCellIndex);
+			for (int lane = 0; lane < RAY_PACKET_SIZE; lane++) {
+				if (activeLanes & (1 << lane)) {
+					steps += skipEmptySpace(&sideDistX[lane], &sideDistY[lane], &cellIndex[lane],
+						deltaDistX[lane], deltaDistY[lane], cellStepX[lane], cellStepY[lane]);
+				}
+			}
+			vSideDistX = _mm_loadu_ps(sideDistX);
+			vSideDistY = _mm_loadu_ps(sideDistY);
+			vCellIndex = _mm_loadu_si128((const __m128i*)cellIndex);
 		}
-		else {
-			nextVerticalTouchX += xStep;
-			nextVerticalTouchY += yStep;
+
+		steps += countActiveLanes(activeLanes);
+		__m128 active = _mm_castsi128_ps(_mm_set_epi32(
+			(activeLanes & 8) ? -1 : 0, (activeLanes & 4) ? -1 : 0,
+			(activeLanes & 2) ? -1 : 0, (activeLanes & 1) ? -1 : 0));
+		__m128 takeX = _mm_cmplt_ps(vSideDistX, vSideDistY);
+		__m128 stepXMask = _mm_and_ps(takeX, active);
+		__m128 stepYMask = _mm_andnot_ps(takeX, active);
+		__m128 sideDist = _mm_or_ps(_mm_and_ps(takeX, vSideDistX), _mm_andnot_ps(takeX, vSideDistY));
+
+		vDistance = _mm_or_ps(_mm_and_ps(active, sideDist), _mm_andnot_ps(active, vDistance));
+		vWasHitVertical = _mm_or_ps(_mm_and_ps(active, takeX), _mm_andnot_ps(active, vWasHitVertical));
+		vSideDistX = _mm_add_ps(vSideDistX, _mm_and_ps(vDeltaDistX, stepXMask));
+		vSideDistY = _mm_add_ps(vSideDistY, _mm_and_ps(vDeltaDistY, stepYMask));
+		vCellIndex = _mm_add_epi32(vCellIndex, _mm_and_si128(vCellStepX, _mm_castps_si128(stepXMask)));
+		vCellIndex = _mm_add_epi32(vCellIndex, _mm_and_si128(vCellStepY, _mm_castps_si128(stepYMask)));
+
+		// SSE2 has no gather, so the map probe is done per lane
+		_mm_storeu_si128((__m128i*)cellIndex, vCellIndex);
+		for (int lane = 0; lane < RAY_PACKET_SIZE; lane++) {
+			if ((activeLanes & (1 << lane)) && mapIsWallAtIndex(cellIndex[lane])) {
+				activeLanes &= ~(1 << lane);
+			}
 		}
 	}
 
-	// Calculate both horizontal and vertica hit distances and chose the smallest one;
-	float horizontalHitDistance = foundHorizontalWallHit 
-		? distanceBetweenPoints(player.x, player.y, horizontalWallHitX, horizontalWallHitY) 
-		: INT_MAX;
-	float verticalHitDistance = foundVerticalWallHit
-		? distanceBetweenPoints(player.x, player.y, verticalWallHitX, verticalWallHitY)
-		: INT_MAX;
+	_mm_store_ps(&rays->distance[stripId], vDistance);
+	_mm_storeu_si128((__m128i*)wasHitVertical, _mm_castps_si128(vWasHitVertical));
+#endif
 
-	if (verticalHitDistance < horizontalHitDistance) {
-		rays[stripId].distance = verticalHitDistance;
-		rays[stripId].wallHitX = verticalWallHitX;
-		rays[stripId].wallHitY = verticalWallHitY;
-		rays[stripId].wallHitContent = verticalWallContent;
-		rays[stripId].wasHitVertical = TRUE;
+	for (int lane = 0; lane < RAY_PACKET_SIZE; lane++) {
+		rays->wallHitContent[stripId + lane] = mapContent[cellIndex[lane]];
+		rayHitCell[stripId + lane] = cellIndex[lane];
+		rays->flags[stripId + lane] = packRayFlags(rayDirX[lane], rayDirY[lane], wasHitVertical[lane]);
+	}
+	return steps;
+}
+#endif
+
+int rayCacheBucket(int stripId) {
+	float worldAngle = camera.rotationAngle + rayColumnAngle[stripId];
+	int bucket = (int)floorf(worldAngle * (RAY_CACHE_BUCKETS / TWO_PI)) % RAY_CACHE_BUCKETS;
+	return bucket < 0 ? bucket + RAY_CACHE_BUCKETS : bucket;
+}
+
+void storeRaysInCache(int begin, int end) {
+	for (int stripId = begin; stripId < end; stripId++) {
+		struct RayCacheEntry* entry = &rayCache[rayCacheBucket(stripId)];
+		entry->cellIndex = rayHitCell[stripId];
+		entry->epochAndSide = rayCacheEpoch << 1 | ((rays->flags[stripId] & RAY_HIT_VERTICAL) ? 1 : 0);
+	}
+}
+
+// Nearest bucket on one side of the given one holding a ray from this epoch,
+// or -1 if there is none within RAY_CACHE_SEARCH buckets
+int findCachedRay(int bucket, int direction) {
+	for (int k = 1; k <= RAY_CACHE_SEARCH; k++) {
+		int neighbor = (bucket + direction * k + RAY_CACHE_BUCKETS) % RAY_CACHE_BUCKETS;
+		if ((rayCache[neighbor].epochAndSide >> 1) == rayCacheEpoch) {
+			return neighbor;
+		}
+	}
+	return -1;
+}
+
+// Rebuilds a ray from the cache when the nearest cached rays on either side of
+// it hit the same wall face: the wedge between them is narrower than a tile,
+// so no wall can hide inside it and the ray in between must hit that face too.
+// The exact ray is then intersected with the face directly.
+// Returns FALSE if the ray has to be cast instead.
+int reuseCachedRay(int stripId) {
+	int bucket = rayCacheBucket(stripId);
+	int below = findCachedRay(bucket, -1);
+	int above = findCachedRay(bucket, +1);
+	if (below < 0 || above < 0 ||
+		rayCache[below].cellIndex != rayCache[above].cellIndex ||
+		rayCache[below].epochAndSide != rayCache[above].epochAndSide) {
+		return FALSE;
+	}
+	struct RayCacheEntry* entry = &rayCache[below];
+	float wedgeAngle = (float)((above - below + RAY_CACHE_BUCKETS) % RAY_CACHE_BUCKETS + 1) * (TWO_PI / RAY_CACHE_BUCKETS);
+
+	float rayDirX, rayDirY;
+	getRayDirection(&camera, stripId, &rayDirX, &rayDirY);
+	int cellIndex = entry->cellIndex;
+	int wasHitVertical = entry->epochAndSide & 1;
+	int cellX = (cellIndex % MAP_STRIDE - 1) * TILE_SIZE;
+	int cellY = (cellIndex / MAP_STRIDE - 1) * TILE_SIZE;
+
+	float distance;
+	if (wasHitVertical) {
+		if (rayDirX == 0 || mapIsWallAtIndex(cellIndex - (rayDirX > 0 ? 1 : -1))) {
+			return FALSE;
+		}
+		distance = (cellX + (rayDirX > 0 ? 0 : TILE_SIZE) - camera.x) / rayDirX;
+		float hitY = camera.y + rayDirY * distance;
+		if (distance < 0 || hitY < cellY || hitY > cellY + TILE_SIZE) {
+			return FALSE;
+		}
 	}
 	else {
-		rays[stripId].distance = horizontalHitDistance;
-		rays[stripId].wallHitX = horizontalWallHitX;
-		rays[stripId].wallHitY = horizontalWallHitY;
-		rays[stripId].wallHitContent = horizontalWallContent;
-		rays[stripId].wasHitVertical = FALSE;
+		if (rayDirY == 0 || mapIsWallAtIndex(cellIndex - (rayDirY > 0 ? MAP_STRIDE : -MAP_STRIDE))) {
+			return FALSE;
+		}
+		distance = (cellY + (rayDirY > 0 ? 0 : TILE_SIZE) - camera.y) / rayDirY;
+		float hitX = camera.x + rayDirX * distance;
+		if (distance < 0 || hitX < cellX || hitX > cellX + TILE_SIZE) {
+			return FALSE;
+		}
+	}
+
+	if (distance * wedgeAngle >= TILE_SIZE) {
+		return FALSE;
+	}
+
+	rays->distance[stripId] = distance;
+	rays->wallHitContent[stripId] = mapContent[cellIndex];
+	rays->flags[stripId] = packRayFlags(rayDirX, rayDirY, wasHitVertical);
+	rayHitCell[stripId] = cellIndex;
+	return TRUE;
+}
+
+// Casts the strips [begin, end) on whichever thread the pool hands them to
+void castRayRange(int begin, int end, void* userData) {
+	(void)userData;
+	int stripId = begin;
+	int steps = 0;
+	TRACE_BEGIN("castRayRange");
+
+#if RAY_PACKET_SIZE > 1
+	for (; stripId + RAY_PACKET_SIZE <= end; stripId += RAY_PACKET_SIZE) {
+		steps += castRayPacket(stripId);
 	}
+#endif
 
-	rays[stripId].rayAngle = rayAngle;
-	rays[stripId].isRayFacingDown = isRayFacingDown;
-	rays[stripId].isRayFacingUp = isRayFacingUp;
-	rays[stripId].isRayFacingLeft = isRayFacingLeft;
-	rays[stripId].isRayFacingRight = isRayFacingRight;
+	// leftover columns that do not fill a whole packet
+	for (; stripId < end; stripId++) {
+		steps += castRay(stripId);
+	}
+
+	SDL_AtomicAdd(&rayStepCount, steps);
+	TRACE_END("castRayRange");
+}
+
+// Rotation-only frames: the origin has not moved, so every column whose world
+// angle was already cast this epoch is rebuilt from the cache and only the
+// newly exposed columns are traversed
+void reuseRayRange(int begin, int end, void* userData) {
+	(void)userData;
+	int steps = 0;
+	TRACE_BEGIN("reuseRayRange");
+	for (int stripId = begin; stripId < end; stripId++) {
+		steps += reuseCachedRay(stripId) ? 1 : castRay(stripId);
+	}
 
+	SDL_AtomicAdd(&rayStepCount, steps);
+	TRACE_END("reuseRayRange");
 }
 
 void castAllRays() {
-	// start first ray substracting half of our FOV
-	float rayAngle = player.rotationAngle - (FOV_ANGLE / 2);
+	int isRotationOnly = USE_ANGULAR_RAY_CACHE && rayCacheEpoch != 0 &&
+		camera.x == rayCacheOriginX && camera.y == rayCacheOriginY && mapVersion == rayCacheMapVersion;
+	if (!isRotationOnly) {
+		rayCacheEpoch++;
+		rayCacheOriginX = camera.x;
+		rayCacheOriginY = camera.y;
+		rayCacheMapVersion = mapVersion;
+	}
+
+	// returns only once every strip is cast, so render() never sees a partial frame
+	parallelFor(isRotationOnly ? reuseRayRange : castRayRange, NUM_RAYS, RAY_CHUNK_ALIGNMENT, NULL);
+	rayCastCount += NUM_RAYS;
 
-	for (int stripId = 0; stripId < NUM_RAYS; stripId++) {
-		castRay(rayAngle, stripId);
-		rayAngle += FOV_ANGLE / NUM_RAYS;
+	// workers only read the cache, it is filled here once they are done
+	if (USE_ANGULAR_RAY_CACHE) {
+		storeRaysInCache(0, NUM_RAYS);
 	}
 }
 
-void renderMap() {
-	for (int r = 0; r < MAP_NUM_ROWS; r++) {
-		for (int c = 0; c < MAP_NUM_COLS; c++) {
-			int tileX = c * TILE_SIZE;
-			int tileY = r * TILE_SIZE;
-			int tileColor = map[r][c] != 0 ? 255 : 0;
+void reportRayStepStats() {
+	int steps = SDL_AtomicSet(&rayStepCount, 0);
+	if (rayCastCount > 0) {
+		printf("Empty-space skipping %s: %.2f steps per ray over %d rays\n",
+			skippingNames[emptySpaceSkipping], (float)steps / rayCastCount, rayCastCount);
+	}
+	rayCastCount = 0;
+}
+
+// Where the ray of a column hit its wall. The buffer only keeps the distance,
+// the direction is rebuilt from the frame's camera.
+void getRayWallHit(const struct Frame* frame, int col, float* hitX, float* hitY) {
+	float rayDirX, rayDirY;
+	getRayDirection(&frame->camera, col, &rayDirX, &rayDirY);
+	*hitX = frame->camera.x + rayDirX * frame->rays.distance[col];
+	*hitY = frame->camera.y + rayDirY * frame->rays.distance[col];
+}
+
+// One textured wall strip per ray. Strips go to the column-major buffer and
+// are transposed into the frame at the end; textures are column-major too, so
+// a strip reads one texel column. Above and below the strip the buffer is left
+// as it was: renderFloorAndCeiling overwrites those pixels after the transpose.
+void renderWallProjection(const struct Frame* frame) {
+	for (int x = 0; x < NUM_RAYS; x++) {
+		float wallHeight = rayColumnWallScale[x] / SDL_max(frame->rays.distance[x], 1.0f);
+		float wallStart = (WINDOW_HEIGHT - wallHeight) / 2; // above the screen when the wall is close
+		int wallTop = SDL_max((int)wallStart, 0);
+		int wallBottom = (int)SDL_min((WINDOW_HEIGHT + wallHeight) / 2, (float)WINDOW_HEIGHT);
+
+		// faces hit on vertical grid lines are lit, horizontal ones shaded
+		uint8_t flags = frame->rays.flags[x];
+		int wasHitVertical = flags & RAY_HIT_VERTICAL;
+		const struct WallTexture* texture = getWallTexture(frame->rays.wallHitContent[x]);
+		const uint32_t* texels = wasHitVertical ? texture->lit : texture->shaded;
 
-			SDL_SetRenderDrawColor(renderer, tileColor, tileColor, tileColor, 255);
-			SDL_Rect mapTileRect = {
-				(int)(tileX * MINIMAP_SCALE_FACTOR),
-				(int)(tileY * MINIMAP_SCALE_FACTOR),
-				(int)(TILE_SIZE * MINIMAP_SCALE_FACTOR),
-				(int)(TILE_SIZE * MINIMAP_SCALE_FACTOR)
-			};
-			SDL_RenderFillRect(renderer, &mapTileRect);
+		// where along the face the ray hit, mirrored on faces seen from the
+		// other side so no texture shows up flipped
+		float hitX, hitY;
+		getRayWallHit(frame, x, &hitX, &hitY);
+		float hitOffset = fmodf(wasHitVertical ? hitY : hitX, TILE_SIZE);
+		int textureX = (int)(hitOffset * ((float)TEXTURE_WIDTH / TILE_SIZE)) & (TEXTURE_WIDTH - 1);
+		if (wasHitVertical ? (flags & RAY_FACING_LEFT) : (flags & RAY_FACING_DOWN)) {
+			textureX = TEXTURE_WIDTH - 1 - textureX;
 		}
+		const uint32_t* texelColumn = &texels[textureX * TEXTURE_HEIGHT];
+
+		// texel row in 16.16 fixed point, one add per pixel instead of a division
+		uint32_t textureStep = (uint32_t)(TEXTURE_HEIGHT * 65536.0f / wallHeight);
+		uint32_t textureY = (uint32_t)((wallTop - wallStart) * textureStep);
+
+		uint32_t* column = &columnBuffer[x * WINDOW_HEIGHT];
+		for (int y = wallTop; y < wallBottom; y++) {
+			column[y] = texelColumn[(textureY >> 16) & (TEXTURE_HEIGHT - 1)];
+			textureY += textureStep;
+		}
+		columnWallTop[x] = wallTop;
+		columnWallBottom[x] = wallBottom;
 	}
+	resolveColumnBuffer();
 }
 
-void renderRays() {
-	SDL_SetRenderDrawColor(renderer, 255, 0, 0, 255);
-	for (int r = 0; r < NUM_RAYS; r++) {
-		SDL_RenderDrawLine(
-			renderer,
-			(int)(MINIMAP_SCALE_FACTOR * player.x),
-			(int)(MINIMAP_SCALE_FACTOR * player.y),
-			(int)(MINIMAP_SCALE_FACTOR * rays[r].wallHitX),
-			(int)(MINIMAP_SCALE_FACTOR * rays[r].wallHitY)
-		);
-	};
-}
+// Floor rows [begin, end) below the horizon, each with the ceiling row
+// mirrored above it. Along a row the floor is at a constant distance, so its
+// world position moves linearly from the left frustum edge ray (dir - plane)
+// to the right one (dir + plane) and every pixel is one multiply-add away
+// from the row start. Pixels covered by a wall strip are left alone.
+void renderFloorRows(int begin, int end, void* userData) {
+	const struct Camera* view = userData;
+	const uint32_t* floorTexels = getWallTexture(FLOOR_TEXTURE)->lit;
+	const uint32_t* ceilingTexels = getWallTexture(CEILING_TEXTURE)->shaded;
+	float textureScaleX = (float)TEXTURE_WIDTH / TILE_SIZE;
+	float textureScaleY = (float)TEXTURE_HEIGHT / TILE_SIZE;
+	TRACE_BEGIN("renderFloorRows");
 
-void processInput() {
-	SDL_Event event;
-	SDL_PollEvent(&event);
-	switch (event.type) {
-		case SDL_QUIT: {
-			isGameRunning = FALSE;
-			break;
+	for (int row = begin; row < end; row++) {
+		int floorY = WINDOW_HEIGHT / 2 + row;
+		int ceilingY = WINDOW_HEIGHT - 1 - floorY;
+		float distance = floorRowDistance[row];
+
+		// texel coordinates under the left edge of the screen and per column
+		float startU = (view->x + distance * (view->dirX - view->planeX)) * textureScaleX;
+		float startV = (view->y + distance * (view->dirY - view->planeY)) * textureScaleY;
+		float stepU = distance * 2 * view->planeX / WINDOW_WIDTH * textureScaleX;
+		float stepV = distance * 2 * view->planeY / WINDOW_WIDTH * textureScaleY;
+
+		uint32_t* floorRow = &colorBuffer[floorY * WINDOW_WIDTH];
+		uint32_t* ceilingRow = &colorBuffer[ceilingY * WINDOW_WIDTH];
+		int x = 0;
+
+#if RAY_PACKET_SIZE == 8
+		__m256 startU8 = _mm256_set1_ps(startU);
+		__m256 startV8 = _mm256_set1_ps(startV);
+		__m256 stepU8 = _mm256_set1_ps(stepU);
+		__m256 stepV8 = _mm256_set1_ps(stepV);
+		__m256 lanes = _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7);
+		__m256i maskU = _mm256_set1_epi32(TEXTURE_WIDTH - 1);
+		__m256i maskV = _mm256_set1_epi32(TEXTURE_HEIGHT - 1);
+		__m256i textureHeight = _mm256_set1_epi32(TEXTURE_HEIGHT);
+		__m256i floorBelow = _mm256_set1_epi32(floorY + 1);
+		__m256i ceilingAt = _mm256_set1_epi32(ceilingY);
+		for (; x + 8 <= WINDOW_WIDTH; x += 8) {
+			__m256 column = _mm256_add_ps(_mm256_set1_ps((float)x), lanes);
+			__m256i u = _mm256_and_si256(_mm256_cvttps_epi32(_mm256_add_ps(startU8, _mm256_mul_ps(stepU8, column))), maskU);
+			__m256i v = _mm256_and_si256(_mm256_cvttps_epi32(_mm256_add_ps(startV8, _mm256_mul_ps(stepV8, column))), maskV);
+			__m256i texel = _mm256_add_epi32(_mm256_mullo_epi32(u, textureHeight), v);
+
+			// floor where the wall ends at or above this row, ceiling where it starts below
+			__m256i isFloor = _mm256_cmpgt_epi32(floorBelow, _mm256_loadu_si256((const __m256i*)&columnWallBottom[x]));
+			__m256i isCeiling = _mm256_cmpgt_epi32(_mm256_loadu_si256((const __m256i*)&columnWallTop[x]), ceilingAt);
+			_mm256_maskstore_epi32((int*)&floorRow[x], isFloor, _mm256_i32gather_epi32((const int*)floorTexels, texel, 4));
+			_mm256_maskstore_epi32((int*)&ceilingRow[x], isCeiling, _mm256_i32gather_epi32((const int*)ceilingTexels, texel, 4));
 		}
-		case SDL_KEYDOWN: {
-			if (event.key.keysym.sym == SDLK_ESCAPE) {
-				isGameRunning = FALSE;
+#elif RAY_PACKET_SIZE == 4
+		__m128 startU4 = _mm_set1_ps(startU);
+		__m128 startV4 = _mm_set1_ps(startV);
+		__m128 stepU4 = _mm_set1_ps(stepU);
+		__m128 stepV4 = _mm_set1_ps(stepV);
+		__m128 lanes = _mm_setr_ps(0, 1, 2, 3);
+		__m128i maskU = _mm_set1_epi32(TEXTURE_WIDTH - 1);
+		__m128i maskV = _mm_set1_epi32(TEXTURE_HEIGHT - 1);
+		__m128i floorBelow = _mm_set1_epi32(floorY + 1);
+		__m128i ceilingAt = _mm_set1_epi32(ceilingY);
+		for (; x + 4 <= WINDOW_WIDTH; x += 4) {
+			__m128 column = _mm_add_ps(_mm_set1_ps((float)x), lanes);
+			__m128i u = _mm_and_si128(_mm_cvttps_epi32(_mm_add_ps(startU4, _mm_mul_ps(stepU4, column))), maskU);
+			__m128i v = _mm_and_si128(_mm_cvttps_epi32(_mm_add_ps(startV4, _mm_mul_ps(stepV4, column))), maskV);
+			// no 32-bit integer multiply before SSE4.1; u is small enough to scale exactly as a float
+			__m128i texel = _mm_add_epi32(_mm_cvttps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(u), _mm_set1_ps(TEXTURE_HEIGHT))), v);
+			int texels[4];
+			_mm_storeu_si128((__m128i*)texels, texel);
+
+			// no gather either: load the four texels, then blend them over the
+			// wall pixels already in the row
+			__m128i floorColors = _mm_setr_epi32(floorTexels[texels[0]], floorTexels[texels[1]],
+				floorTexels[texels[2]], floorTexels[texels[3]]);
+			__m128i ceilingColors = _mm_setr_epi32(ceilingTexels[texels[0]], ceilingTexels[texels[1]],
+				ceilingTexels[texels[2]], ceilingTexels[texels[3]]);
+			__m128i isFloor = _mm_cmpgt_epi32(floorBelow, _mm_loadu_si128((const __m128i*)&columnWallBottom[x]));
+			__m128i isCeiling = _mm_cmpgt_epi32(_mm_loadu_si128((const __m128i*)&columnWallTop[x]), ceilingAt);
+			__m128i floorPixels = _mm_loadu_si128((const __m128i*)&floorRow[x]);
+			__m128i ceilingPixels = _mm_loadu_si128((const __m128i*)&ceilingRow[x]);
+			_mm_storeu_si128((__m128i*)&floorRow[x],
+				_mm_or_si128(_mm_and_si128(isFloor, floorColors), _mm_andnot_si128(isFloor, floorPixels)));
+			_mm_storeu_si128((__m128i*)&ceilingRow[x],
+				_mm_or_si128(_mm_and_si128(isCeiling, ceilingColors), _mm_andnot_si128(isCeiling, ceilingPixels)));
+		}
+#endif
+
+		for (; x < WINDOW_WIDTH; x++) {
+			int u = (int)(startU + stepU * x) & (TEXTURE_WIDTH - 1);
+			int v = (int)(startV + stepV * x) & (TEXTURE_HEIGHT - 1);
+			int texel = u * TEXTURE_HEIGHT + v;
+			if (columnWallBottom[x] <= floorY) {
+				floorRow[x] = floorTexels[texel];
 			}
-			if (event.key.keysym.sym == SDLK_UP) {
-				player.walkDirection = +1;
+			if (columnWallTop[x] > ceilingY) {
+				ceilingRow[x] = ceilingTexels[texel];
 			}
-			if (event.key.keysym.sym == SDLK_DOWN) {
-				player.walkDirection = -1;
+		}
+	}
+	TRACE_END("renderFloorRows");
+}
+
+// Runs after renderWallProjection, whose strip bounds it reads
+void renderFloorAndCeiling(const struct Frame* frame) {
+	parallelFor(renderFloorRows, NUM_FLOOR_ROWS, 1, (void*)&frame->camera);
+}
+
+void drawSprite(int index) {
+	const struct SpriteProjection* projection = &spriteProjections[index];
+	const struct SpriteTexture* texture = &spriteTextures[sprites[index].texture];
+	float texelsPerColumn = TEXTURE_WIDTH / projection->size;
+	float texelsPerRow = TEXTURE_HEIGHT / projection->size;
+
+	int numColumns = 0;
+	for (int x = projection->firstColumn; x < projection->endColumn; x++) {
+		if (projection->depth < columnWallDepth[x]) {
+			int u = SDL_min((int)((x + 0.5f - projection->left) * texelsPerColumn), TEXTURE_WIDTH - 1);
+			spriteColumnX[numColumns] = x;
+			spriteColumnTexels[numColumns] = u * TEXTURE_HEIGHT;
+			numColumns++;
+		}
+	}
+	if (numColumns == 0) {
+		return;
+	}
+
+	// a sprite is as tall as a wall at the same depth, the texture places it within that
+	float top = (WINDOW_HEIGHT - projection->size) / 2;
+	int firstRow = SDL_max((int)ceilf(top + texture->opaqueTop / texelsPerRow - 0.5f), 0);
+	int endRow = SDL_min((int)ceilf(top + texture->opaqueBottom / texelsPerRow - 0.5f), WINDOW_HEIGHT);
+	for (int y = firstRow; y < endRow; y++) {
+		int v = SDL_min((int)((y + 0.5f - top) * texelsPerRow), TEXTURE_HEIGHT - 1);
+		const uint32_t* texelRow = &texture->texels[v];
+		uint32_t* row = &colorBuffer[y * WINDOW_WIDTH];
+		for (int i = 0; i < numColumns; i++) {
+			uint32_t texel = texelRow[spriteColumnTexels[i]];
+			if (texel >> 24) {
+				row[spriteColumnX[i]] = texel;
 			}
-			if (event.key.keysym.sym == SDLK_LEFT) {
-				player.turnDirection = -1;
+		}
+	}
+}
+
+// Projects every sprite, culls those off screen or behind walls, then draws
+// the rest back to front over the 3D view, testing each column against the
+// walls' depth. Only sprites that pass culling cost more than a few flops.
+void renderSprites(const struct Frame* frame) {
+	const struct Camera* view = &frame->camera;
+	float projectionDistance = (WINDOW_WIDTH / 2) / tanf(FOV_ANGLE / 2);
+	float planeLengthSquared = view->planeX * view->planeX + view->planeY * view->planeY;
+
+	// the cast distances run along each ray, sprites are compared along the view direction
+	for (int block = 0; block < NUM_SPRITE_CULL_BLOCKS; block++) {
+		int end = SDL_min((block + 1) * SPRITE_CULL_BLOCK, NUM_RAYS);
+		float farthest = 0;
+		for (int x = block * SPRITE_CULL_BLOCK; x < end; x++) {
+			columnWallDepth[x] = frame->rays.distance[x] * rayColumnScale[x];
+			farthest = SDL_max(farthest, columnWallDepth[x]);
+		}
+		blockWallDepth[block] = farthest;
+	}
+
+	int numVisible = 0;
+	for (int i = 0; i < NUM_SPRITES; i++) {
+		float relativeX = sprites[i].x - view->x;
+		float relativeY = sprites[i].y - view->y;
+		float depth = relativeX * view->dirX + relativeY * view->dirY;
+		if (depth < SPRITE_NEAR_DEPTH) {
+			continue;
+		}
+
+		// the same cameraX the column rays are built from, mapped to pixels
+		float cameraX = (relativeX * view->planeX + relativeY * view->planeY) / (depth * planeLengthSquared);
+		float size = TILE_SIZE * projectionDistance / depth;
+		float left = (cameraX + 1) * (WINDOW_WIDTH / 2) - size / 2;
+		const struct SpriteTexture* texture = &spriteTextures[sprites[i].texture];
+		int firstColumn = SDL_max((int)ceilf(left + texture->opaqueLeft * size / TEXTURE_WIDTH - 0.5f), 0);
+		int endColumn = SDL_min((int)ceilf(left + texture->opaqueRight * size / TEXTURE_WIDTH - 0.5f), WINDOW_WIDTH);
+		if (firstColumn >= endColumn) {
+			continue;
+		}
+
+		int isOccluded = TRUE;
+		for (int block = firstColumn / SPRITE_CULL_BLOCK; block <= (endColumn - 1) / SPRITE_CULL_BLOCK; block++) {
+			if (depth < blockWallDepth[block]) {
+				isOccluded = FALSE;
+				break;
 			}
-			if (event.key.keysym.sym == SDLK_RIGHT) {
-				player.turnDirection = +1;
+		}
+		if (isOccluded) {
+			continue;
+		}
+
+		struct SpriteProjection* projection = &spriteProjections[i];
+		projection->depth = depth;
+		projection->left = left;
+		projection->size = size;
+		projection->firstColumn = firstColumn;
+		projection->endColumn = endColumn;
+		uint32_t depthKey = (uint32_t)SDL_min(depth * (65535 / SPRITE_MAX_DEPTH), 65535.0f);
+		visibleSprites[numVisible++] = depthKey << 16 | (uint32_t)i;
+	}
+
+	radixSortByKey(visibleSprites, visibleSpritesScratch, numVisible);
+	for (int i = numVisible - 1; i >= 0; i--) {
+		drawSprite(visibleSprites[i] & 0xFFFF);
+	}
+}
+
+int buildMinimap(int version) {
+	int tileSize = (int)(TILE_SIZE * MINIMAP_SCALE_FACTOR);
+	if (minimapPixels == NULL) {
+		minimapWidth = (int)((MAP_NUM_COLS - 1) * TILE_SIZE * MINIMAP_SCALE_FACTOR) + tileSize;
+		minimapHeight = (int)((MAP_NUM_ROWS - 1) * TILE_SIZE * MINIMAP_SCALE_FACTOR) + tileSize;
+		minimapPixels = malloc(sizeof(uint32_t) * minimapWidth * minimapHeight);
+		if (minimapPixels == NULL) {
+			fprintf(stderr, "Error allocating the minimap.\n");
+			return FALSE;
+		}
+	}
+
+	for (int r = 0; r < MAP_NUM_ROWS; r++) {
+		for (int c = 0; c < MAP_NUM_COLS; c++) {
+			int tileX = (int)(c * TILE_SIZE * MINIMAP_SCALE_FACTOR);
+			int tileY = (int)(r * TILE_SIZE * MINIMAP_SCALE_FACTOR);
+			uint32_t tileColor = getMapTile(c, r) != 0 ? 0xFFFFFFFF : 0xFF000000;
+			for (int y = tileY; y < tileY + tileSize; y++) {
+				uint32_t* pixel = &minimapPixels[y * minimapWidth];
+				for (int x = tileX; x < tileX + tileSize; x++) {
+					pixel[x] = tileColor;
+				}
 			}
+		}
+	}
+	minimapVersion = version;
+	return TRUE;
+}
 
-			break;
+void renderMap(const struct Frame* frame) {
+	if (minimapPixels == NULL || minimapVersion != frame->mapVersion) {
+		if (!buildMinimap(frame->mapVersion)) {
+			return;
 		}
-		case SDL_KEYUP: {
-			if (event.key.keysym.sym == SDLK_UP) {
-				player.walkDirection = 0;
+	}
+	drawImage(minimapPixels, 0, 0, minimapWidth, minimapHeight);
+}
+
+// Draws what the rays see as one filled polygon: the camera, then the wall
+// hits from left to right. Consecutive hits on one wall face are collinear,
+// so only the vertices where the outline turns are kept.
+void renderRays(const struct Frame* frame) {
+	visibilityX[0] = MINIMAP_SCALE_FACTOR * frame->camera.x;
+	visibilityY[0] = MINIMAP_SCALE_FACTOR * frame->camera.y;
+	int count = 1;
+	for (int r = 0; r < NUM_RAYS; r++) {
+		float hitX, hitY;
+		getRayWallHit(frame, r, &hitX, &hitY);
+		float x = MINIMAP_SCALE_FACTOR * hitX;
+		float y = MINIMAP_SCALE_FACTOR * hitY;
+		if (count >= 3) {
+			// the last vertex is dropped when it lies on the line from the one before it to this hit
+			float baseX = visibilityX[count - 2];
+			float baseY = visibilityY[count - 2];
+			float lastX = visibilityX[count - 1] - baseX;
+			float lastY = visibilityY[count - 1] - baseY;
+			float cross = lastX * (y - baseY) - lastY * (x - baseX);
+			float lengthSquared = (x - baseX) * (x - baseX) + (y - baseY) * (y - baseY);
+			if (cross * cross <= VISIBILITY_TOLERANCE * VISIBILITY_TOLERANCE * lengthSquared) {
+				count--;
 			}
-			if (event.key.keysym.sym == SDLK_DOWN) {
-				player.walkDirection = 0;
+		}
+		visibilityX[count] = x;
+		visibilityY[count] = y;
+		count++;
+	}
+	fillPolygon(visibilityX, visibilityY, count, 0xFFFF0000);
+}
+
+// Event timestamps are SDL_GetTicks milliseconds, frame times are on the performance counter
+Uint64 getEventCounter(Uint32 timestamp) {
+	Uint64 age = (Uint64)(SDL_GetTicks() - timestamp) * SDL_GetPerformanceFrequency() / 1000;
+	return SDL_GetPerformanceCounter() - age;
+}
+
+// Drains the whole event queue every frame, then takes movement from a snapshot
+// of the keyboard state, so a press and release arriving in the same frame can
+// neither lag behind nor leave a key stuck
+int isMovementKey(SDL_Scancode scancode) {
+	return scancode == SDL_SCANCODE_UP || scancode == SDL_SCANCODE_DOWN ||
+		scancode == SDL_SCANCODE_LEFT || scancode == SDL_SCANCODE_RIGHT;
+}
+
+void processInput() {
+	SDL_Event event;
+	while (SDL_PollEvent(&event)) {
+		switch (event.type) {
+			case SDL_QUIT: {
+				isGameRunning = FALSE;
+				break;
 			}
-			if (event.key.keysym.sym == SDLK_LEFT) {
-				player.turnDirection = 0;
+			case SDL_WINDOWEVENT: {
+				// the window contents were lost or resized, draw them again
+				if (event.window.event == SDL_WINDOWEVENT_EXPOSED ||
+					event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED) {
+					isFrameDirty = TRUE;
+				}
+				break;
 			}
-			if (event.key.keysym.sym == SDLK_RIGHT) {
-				player.turnDirection = 0;
+			case SDL_KEYDOWN:
+			case SDL_KEYUP: {
+				if (event.key.repeat) {
+					break;
+				}
+				if (isMovementKey(event.key.keysym.scancode) && pendingEventTime == 0) {
+					pendingEventTime = getEventCounter(event.key.timestamp);
+				}
+				if (event.type == SDL_KEYUP) {
+					break;
+				}
+				if (event.key.keysym.sym == SDLK_ESCAPE) {
+					isGameRunning = FALSE;
+				}
+				if (event.key.keysym.sym == SDLK_e) {
+					// print how the mode we are leaving did, then cycle to the next one
+					reportRayStepStats();
+					emptySpaceSkipping = (emptySpaceSkipping + 1) % NUM_SKIP_MODES;
+				}
+				if (event.key.keysym.sym == SDLK_p) {
+					writeProfile(profilePath);
+				}
+				break;
 			}
-			
+		}
+	}
+
+	const Uint8* keys = SDL_GetKeyboardState(NULL);
+	player.walkDirection = keys[SDL_SCANCODE_UP] - keys[SDL_SCANCODE_DOWN];
+	player.turnDirection = keys[SDL_SCANCODE_RIGHT] - keys[SDL_SCANCODE_LEFT];
+}
+
+// Simulation stage: moves the player by the frame time and casts the view
+// into the frame the main thread is not showing
+void update(float perSecond, Uint64 inputTime) {
+	TRACE_BEGIN("update");
+	// advance the simulation in fixed steps, however long the frame took;
+	// a long stall is dropped rather than replayed all at once
+	beginProfilePhase(PROFILE_MOVE_PLAYER);
+	simulationAccumulator += SDL_min(perSecond, MAX_FRAME_TIME);
+	int hasStepped = simulationAccumulator >= SIMULATION_STEP;
+	while (simulationAccumulator >= SIMULATION_STEP) {
+		previousPlayer = player;
+		movePlayer(SIMULATION_STEP);
+		simulationAccumulator -= SIMULATION_STEP;
+	}
+	endProfilePhase(PROFILE_MOVE_PLAYER);
+	updateCamera(simulationAccumulator / SIMULATION_STEP);
+
+	if (camera.x != lastCastX || camera.y != lastCastY ||
+		camera.rotationAngle != lastCastAngle || mapVersion != lastCastMapVersion) {
+		isViewDirty = TRUE;
+	}
+	if (isViewDirty) {
+		int sequence = SDL_AtomicGet(&publishedSequence);
+		struct Frame* frame = &frames[(sequence + 1) & 1];
+		rays = &frame->rays;
+		beginProfilePhase(PROFILE_CAST_ALL_RAYS);
+		castAllRays();
+		endProfilePhase(PROFILE_CAST_ALL_RAYS);
+		frame->camera = camera;
+		frame->inputTime = inputTime;
+		frame->eventTime = pendingEventTime;
+		frame->mapVersion = mapVersion;
+		pendingEventTime = 0;
+		SDL_AtomicSet(&publishedSequence, sequence + 1);
+
+		lastCastX = camera.x;
+		lastCastY = camera.y;
+		lastCastAngle = camera.rotationAngle;
+		lastCastMapVersion = mapVersion;
+		isViewDirty = FALSE;
+	}
+	else if (hasStepped) {
+		// the key was simulated without moving the view (held against a
+		// wall), so no frame will ever show it
+		pendingEventTime = 0;
+	}
+	TRACE_END("update");
+}
+
+int runSimulation(void* data) {
+	(void)data;
+	TRACE_THREAD_NAME("simulation");
+	for (;;) {
+		SDL_SemWait(simulationStart);
+		if (isSimulationStopping) {
 			break;
 		}
+		update(pendingFrameTime, pendingInputTime);
+		SDL_SemPost(simulationDone);
 	}
+	return 0;
 }
 
-void update() {
-	// wate some time until we reach the target frame time left
-	while (!SDL_TICKS_PASSED(SDL_GetTicks(), ticksLastFrame + FRAME_TIME_LENGTH));
-	float perSecond = (SDL_GetTicks() - ticksLastFrame) / 1000.0f;
-	ticksLastFrame = SDL_GetTicks();
-	
-	//TODO: remember to update game objject as a function of perSecond
-	movePlayer(perSecond);
-	castAllRays();
+int startSimulationThread() {
+	simulationStart = SDL_CreateSemaphore(0);
+	simulationDone = SDL_CreateSemaphore(0);
+	if (simulationStart != NULL && simulationDone != NULL) {
+		simulationThread = SDL_CreateThread(runSimulation, "simulation", NULL);
+	}
+	if (simulationThread == NULL) {
+		fprintf(stderr, "Error creating the simulation thread: %s\n", SDL_GetError());
+		return FALSE;
+	}
+	return TRUE;
+}
+
+void stopSimulationThread() {
+	if (simulationThread != NULL) {
+		isSimulationStopping = TRUE;
+		SDL_SemPost(simulationStart);
+		SDL_WaitThread(simulationThread, NULL);
+		simulationThread = NULL;
+	}
+	if (simulationStart != NULL) {
+		SDL_DestroySemaphore(simulationStart);
+		simulationStart = NULL;
+	}
+	if (simulationDone != NULL) {
+		SDL_DestroySemaphore(simulationDone);
+		simulationDone = NULL;
+	}
+}
+
+// Kicks off the simulation of the next frame, on the simulation thread when
+// pipelined, otherwise right here
+void beginSimulation(float perSecond) {
+	pendingFrameTime = perSecond;
+	pendingInputTime = SDL_GetPerformanceCounter();
+	if (isPipelined) {
+		SDL_SemPost(simulationStart);
+	}
+	else {
+		update(pendingFrameTime, pendingInputTime);
+	}
+}
+
+// Picks up the newest frame the simulation stage published, if it is not on screen yet
+void receiveFrame() {
+	int sequence = SDL_AtomicGet(&publishedSequence);
+	if (sequence != displayedSequence) {
+		displayedSequence = sequence;
+		isFrameDirty = TRUE;
+	}
+}
+
+// Waits for the simulation stage to be done with the next frame
+void finishSimulation() {
+	if (isPipelined) {
+		TRACE_BEGIN("waitForSimulation");
+		SDL_SemWait(simulationDone);
+		TRACE_END("waitForSimulation");
+	}
+	receiveFrame();
+}
+
+void reportFrameLatency() {
+	if (latencyFrames > 0) {
+		printf("Input to present latency (%s): %.2f ms average, %.2f ms worst over %d frames\n",
+			isPipelined ? "pipelined" : "sequential",
+			latencyTotal / latencyFrames * 1000, latencyMax * 1000, latencyFrames);
+	}
+	if (eventLatencyFrames > 0) {
+		printf("Key event to present latency: %.2f ms average, %.2f ms worst over %d frames\n",
+			eventLatencyTotal / eventLatencyFrames * 1000, eventLatencyMax * 1000, eventLatencyFrames);
+	}
 }
 
 void render() {
-	SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
-	SDL_RenderClear(renderer);
+	// the window still shows the last presented frame
+	if (!isFrameDirty && !REDRAW_UNCHANGED_FRAMES) {
+		return;
+	}
+	isFrameDirty = FALSE;
+	const struct Frame* frame = &frames[displayedSequence & 1];
+	TRACE_BEGIN("render");
 
-	// TODO:
-	// render all game objects for the current frame
-	renderMap();
-	renderRays();
-	renderPlayer();
+	beginProfilePhase(PROFILE_RENDER_WALLS);
+	renderWallProjection(frame);
+	endProfilePhase(PROFILE_RENDER_WALLS);
+
+	beginProfilePhase(PROFILE_RENDER_FLOOR);
+	renderFloorAndCeiling(frame);
+	endProfilePhase(PROFILE_RENDER_FLOOR);
+
+	beginProfilePhase(PROFILE_RENDER_SPRITES);
+	renderSprites(frame);
+	endProfilePhase(PROFILE_RENDER_SPRITES);
+
+	// the minimap is drawn over the 3D view
+	beginProfilePhase(PROFILE_RENDER_MAP);
+	renderMap(frame);
+	endProfilePhase(PROFILE_RENDER_MAP);
+	beginProfilePhase(PROFILE_RENDER_RAYS);
+	renderRays(frame);
+	endProfilePhase(PROFILE_RENDER_RAYS);
+	beginProfilePhase(PROFILE_RENDER_PLAYER);
+	renderPlayer(frame);
+	endProfilePhase(PROFILE_RENDER_PLAYER);
+
+	beginProfilePhase(PROFILE_RENDER_COLOR_BUFFER);
+	renderColorBuffer(renderer);
+	endProfilePhase(PROFILE_RENDER_COLOR_BUFFER);
 
+	beginProfilePhase(PROFILE_RENDER_PRESENT);
 	SDL_RenderPresent(renderer);
+	endProfilePhase(PROFILE_RENDER_PRESENT);
+	TRACE_END("render");
+
+	// redraws of a frame already on screen say nothing about input latency
+	if (displayedSequence == measuredSequence) {
+		return;
+	}
+	measuredSequence = displayedSequence;
+	Uint64 presentTime = SDL_GetPerformanceCounter();
+	double latency = (double)(presentTime - frame->inputTime) / SDL_GetPerformanceFrequency();
+	latencyTotal += latency;
+	latencyMax = SDL_max(latencyMax, latency);
+	latencyFrames++;
+
+	if (frame->eventTime != 0) {
+		double eventLatency = (double)(presentTime - frame->eventTime) / SDL_GetPerformanceFrequency();
+		eventLatencyTotal += eventLatency;
+		eventLatencyMax = SDL_max(eventLatencyMax, eventLatency);
+		eventLatencyFrames++;
+	}
+}
+
+// Benchmark camera paths, replayed through movePlayer one simulation step at a
+// time. Each segment holds the walk and turn input for a number of steps.
+struct PathSegment {
+	int steps;
+	int walkDirection;
+	int turnDirection;
+};
+
+struct CameraPath {
+	const char* name;
+	const struct PathSegment* segments;
+	int numSegments;
+};
+
+// a full turn in place, which the angular ray cache serves almost entirely
+static const struct PathSegment spinPath[] = {
+	{ 8 * SIMULATION_HZ, 0, +1 }
+};
+// walking the open room, turning between legs and backing off the walls
+static const struct PathSegment walkPath[] = {
+	{ 90, +1, 0 },
+	{ 120, 0, +1 },
+	{ 180, +1, 0 },
+	{ 60, +1, -1 },
+	{ 240, +1, +1 },
+	{ 120, -1, 0 },
+	{ 180, 0, -1 },
+	{ 240, +1, 0 }
+};
+// moving and turning at once, so every frame needs a full cast
+static const struct PathSegment orbitPath[] = {
+	{ 16 * SIMULATION_HZ, +1, +1 }
+};
+
+static const struct CameraPath cameraPaths[] = {
+	{ "spin", spinPath, sizeof(spinPath) / sizeof(spinPath[0]) },
+	{ "walk", walkPath, sizeof(walkPath) / sizeof(walkPath[0]) },
+	{ "orbit", orbitPath, sizeof(orbitPath) / sizeof(orbitPath[0]) }
+};
+#define NUM_CAMERA_PATHS (int)(sizeof(cameraPaths) / sizeof(cameraPaths[0]))
+
+int isBenchmark = FALSE;
+
+int compareFrameTimes(const void* a, const void* b) {
+	Uint64 timeA = *(const Uint64*)a;
+	Uint64 timeB = *(const Uint64*)b;
+	return (timeA > timeB) - (timeA < timeB);
+}
+
+// Replays every camera path under every empty-space skipping mode without a
+// window and prints the results as JSON. A frame is one simulation step plus a
+// full ray pass, timed together.
+void runBenchmark() {
+	struct Player startPlayer = player;
+	double frequency = (double)SDL_GetPerformanceFrequency();
+
+	printf("{\n");
+	printf("\t\"raysPerFrame\": %d,\n", NUM_RAYS);
+	printf("\t\"rayPacketSize\": %d,\n", RAY_PACKET_SIZE);
+	printf("\t\"threads\": %d,\n", getThreadPoolSize());
+	printf("\t\"angularRayCache\": %s,\n", USE_ANGULAR_RAY_CACHE ? "true" : "false");
+	printf("\t\"runs\": [");
+
+	for (int mode = 0; mode < NUM_SKIP_MODES; mode++) {
+		for (int p = 0; p < NUM_CAMERA_PATHS; p++) {
+			const struct CameraPath* path = &cameraPaths[p];
+			int numFrames = 0;
+			for (int i = 0; i < path->numSegments; i++) {
+				numFrames += path->segments[i].steps;
+			}
+			Uint64* frameTimes = malloc(numFrames * sizeof(Uint64));
+			if (frameTimes == NULL) {
+				fprintf(stderr, "Out of memory for the benchmark frame times.\n");
+				return;
+			}
+
+			emptySpaceSkipping = mode;
+			player = startPlayer;
+			SDL_AtomicSet(&rayStepCount, 0);
+
+			int frame = 0;
+			Uint64 runStart = SDL_GetPerformanceCounter();
+			for (int i = 0; i < path->numSegments; i++) {
+				player.walkDirection = path->segments[i].walkDirection;
+				player.turnDirection = path->segments[i].turnDirection;
+				for (int step = 0; step < path->segments[i].steps; step++) {
+					Uint64 frameStart = SDL_GetPerformanceCounter();
+					previousPlayer = player;
+					movePlayer(SIMULATION_STEP);
+					updateCamera(1.0f);
+					castAllRays();
+					frameTimes[frame++] = SDL_GetPerformanceCounter() - frameStart;
+				}
+			}
+			double seconds = (SDL_GetPerformanceCounter() - runStart) / frequency;
+			int steps = SDL_AtomicSet(&rayStepCount, 0);
+			double numRays = (double)numFrames * NUM_RAYS;
+
+			qsort(frameTimes, numFrames, sizeof(Uint64), compareFrameTimes);
+			double p50 = frameTimes[(numFrames - 1) / 2] / frequency;
+			double p99 = frameTimes[(int)((numFrames - 1) * 0.99)] / frequency;
+			free(frameTimes);
+
+			printf("%s\n\t\t{\n", mode == 0 && p == 0 ? "" : ",");
+			printf("\t\t\t\"path\": \"%s\",\n", path->name);
+			printf("\t\t\t\"skipping\": \"%s\",\n", skippingNames[mode]);
+			printf("\t\t\t\"frames\": %d,\n", numFrames);
+			printf("\t\t\t\"raysPerSecond\": %.0f,\n", numRays / seconds);
+			printf("\t\t\t\"nsPerRay\": %.2f,\n", seconds * 1e9 / numRays);
+			printf("\t\t\t\"cellsPerRay\": %.3f,\n", steps / numRays);
+			printf("\t\t\t\"frameTimeP50Ms\": %.4f,\n", p50 * 1000);
+			printf("\t\t\t\"frameTimeP99Ms\": %.4f\n", p99 * 1000);
+			printf("\t\t}");
+		}
+	}
+	printf("\n\t]\n}\n");
+	rayCastCount = 0;
 }
 
 int main(int argc, char* argv[]) {
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+			numRaycastThreads = atoi(argv[++i]);
+		}
+		if (strcmp(argv[i], "--fps") == 0 && i + 1 < argc) {
+			targetFps = (float)atof(argv[++i]);
+		}
+		if (strcmp(argv[i], "--vsync") == 0) {
+			useVsync = TRUE;
+		}
+		if (strcmp(argv[i], "--no-pipeline") == 0) {
+			isPipelined = FALSE;
+		}
+		if (strcmp(argv[i], "--profile") == 0 && i + 1 < argc) {
+			profilePath = argv[++i];
+			isProfileWrittenAtExit = TRUE;
+		}
+		if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+			tracePath = argv[++i];
+		}
+		if (strcmp(argv[i], "--benchmark") == 0) {
+			isBenchmark = TRUE;
+		}
+	}
+
+	// headless: no window, renderer or input, results go to stdout
+	if (isBenchmark) {
+		setup();
+		runBenchmark();
+		destroyThreadPool();
+		return 0;
+	}
+
 	isGameRunning = initializeWindow();
 
 	setup();
 
+	TRACE_THREAD_NAME("main");
+	if (tracePath != NULL && !TRACE_START(tracePath) && !ENABLE_TRACING) {
+		fprintf(stderr, "Tracing is not compiled into this build.\n");
+	}
+
+	// cast the first frame up front so there is always one to draw
+	update(0, SDL_GetPerformanceCounter());
+	receiveFrame();
+
+	if (isPipelined && !startSimulationThread()) {
+		fprintf(stderr, "Falling back to simulating on the main thread.\n");
+		isPipelined = FALSE;
+	}
+
 	while (isGameRunning) {
+		TRACE_BEGIN("waitForNextFrame");
+		float perSecond = waitForNextFrame();
+		TRACE_END("waitForNextFrame");
+		beginProfilePhase(PROFILE_PROCESS_INPUT);
 		processInput();
-		update();
-		render();
+		endProfilePhase(PROFILE_PROCESS_INPUT);
+		if (isPipelined) {
+			// frame N is drawn while frame N+1 is simulated and cast
+			beginSimulation(perSecond);
+			render();
+			finishSimulation();
+		}
+		else {
+			beginSimulation(perSecond);
+			finishSimulation();
+			render();
+		}
+	}
+	stopSimulationThread();
+	TRACE_STOP();
+	reportFrameLimiterStats();
+	reportFrameLatency();
+	if (isProfileWrittenAtExit) {
+		writeProfile(profilePath);
 	}
+	destroyThreadPool();
 	destroyWindow();
 	return 0;
 }
\ No newline at end of file
@@ -0,0 +1,242 @@
+#include <SDL.h>
+#include "map.h"
+
+static const uint8_t levelLayout[MAP_NUM_ROWS][MAP_NUM_COLS] = {
+	{1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1},
+	{1,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,1},
+	{1,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,1},
+	{1,0,0,0,2,0,2,0,2,0,2,0,2,0,2,0,2,0,0,1},
+	{1,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,1},
+	{1,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,3,0,0,1},
+	{1,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,3,0,0,1},
+	{1,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,3,0,0,1},
+	{1,0,0,0,0,0,0,0,0,0,0,0,0,4,4,4,3,0,0,1},
+	{1,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,1},
+	{1,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,1},
+	{1,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,0,1},
+	{1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1,1}
+};
+
+uint32_t mapOccupancy[(MAP_NUM_CELLS + 31) / 32];
+uint8_t mapContent[MAP_NUM_CELLS];
+uint8_t mapDistance[MAP_NUM_CELLS + 3];
+
+int mapVersion = 0;
+
+uint32_t mapPyramid[(MAP_PYRAMID_BITS + 31) / 32];
+int mapPyramidLevels = 0;
+int mapPyramidStride[MAP_MAX_PYRAMID_LEVELS + 1];
+int mapPyramidOffset[MAP_MAX_PYRAMID_LEVELS + 1];
+static int mapPyramidRows[MAP_MAX_PYRAMID_LEVELS + 1];
+
+static void setCell(int index, int content) {
+	mapContent[index] = (uint8_t)content;
+	if (content != 0) {
+		mapOccupancy[index >> 5] |= 1u << (index & 31);
+	}
+	else {
+		mapOccupancy[index >> 5] &= ~(1u << (index & 31));
+	}
+}
+
+// Two-pass chessboard distance transform over the padded cells in
+// [minCol, maxCol] x [minRow, maxRow]. Cells outside the window keep their
+// distances and seed the ones inside, so a window covering everything
+// within MAP_MAX_DISTANCE of a changed tile gives the same result as
+// rebuilding the whole field.
+static void computeDistanceField(int minCol, int minRow, int maxCol, int maxRow) {
+	minCol = minCol < 0 ? 0 : minCol;
+	minRow = minRow < 0 ? 0 : minRow;
+	maxCol = maxCol >= MAP_STRIDE ? MAP_STRIDE - 1 : maxCol;
+	maxRow = maxRow >= MAP_PADDED_ROWS ? MAP_PADDED_ROWS - 1 : maxRow;
+
+	for (int r = minRow; r <= maxRow; r++) {
+		for (int c = minCol; c <= maxCol; c++) {
+			int index = r * MAP_STRIDE + c;
+			mapDistance[index] = mapIsWallAtIndex(index) ? 0 : MAP_MAX_DISTANCE;
+		}
+	}
+
+	// forward pass pulls distances from the left and the row above
+	for (int r = minRow; r <= maxRow; r++) {
+		for (int c = minCol; c <= maxCol; c++) {
+			int index = r * MAP_STRIDE + c;
+			int d = mapDistance[index];
+			if (d == 0) {
+				continue;
+			}
+			if (c > 0) {
+				d = SDL_min(d, mapDistance[index - 1] + 1);
+			}
+			if (r > 0) {
+				d = SDL_min(d, mapDistance[index - MAP_STRIDE] + 1);
+				if (c > 0) {
+					d = SDL_min(d, mapDistance[index - MAP_STRIDE - 1] + 1);
+				}
+				if (c < MAP_STRIDE - 1) {
+					d = SDL_min(d, mapDistance[index - MAP_STRIDE + 1] + 1);
+				}
+			}
+			mapDistance[index] = (uint8_t)d;
+		}
+	}
+
+	// backward pass pulls distances from the right and the row below
+	for (int r = maxRow; r >= minRow; r--) {
+		for (int c = maxCol; c >= minCol; c--) {
+			int index = r * MAP_STRIDE + c;
+			int d = mapDistance[index];
+			if (d == 0) {
+				continue;
+			}
+			if (c < MAP_STRIDE - 1) {
+				d = SDL_min(d, mapDistance[index + 1] + 1);
+			}
+			if (r < MAP_PADDED_ROWS - 1) {
+				d = SDL_min(d, mapDistance[index + MAP_STRIDE] + 1);
+				if (c > 0) {
+					d = SDL_min(d, mapDistance[index + MAP_STRIDE - 1] + 1);
+				}
+				if (c < MAP_STRIDE - 1) {
+					d = SDL_min(d, mapDistance[index + MAP_STRIDE + 1] + 1);
+				}
+			}
+			mapDistance[index] = (uint8_t)d;
+		}
+	}
+}
+
+static int pyramidChildHasWall(int level, int col, int row) {
+	if (level == 0) {
+		if (col >= MAP_STRIDE || row >= MAP_PADDED_ROWS) {
+			return 0;
+		}
+		return mapIsWallAtIndex(row * MAP_STRIDE + col);
+	}
+	if (col >= mapPyramidStride[level] || row >= mapPyramidRows[level]) {
+		return 0;
+	}
+	return mapBlockHasWall(level, col, row);
+}
+
+// Recomputes one pyramid bit as the OR of its 2x2 children on the level below
+static void updatePyramidBlock(int level, int col, int row) {
+	int hasWall =
+		pyramidChildHasWall(level - 1, col * 2, row * 2) |
+		pyramidChildHasWall(level - 1, col * 2 + 1, row * 2) |
+		pyramidChildHasWall(level - 1, col * 2, row * 2 + 1) |
+		pyramidChildHasWall(level - 1, col * 2 + 1, row * 2 + 1);
+	int bit = mapPyramidOffset[level] + row * mapPyramidStride[level] + col;
+	if (hasWall) {
+		mapPyramid[bit >> 5] |= 1u << (bit & 31);
+	}
+	else {
+		mapPyramid[bit >> 5] &= ~(1u << (bit & 31));
+	}
+}
+
+static void buildPyramid(void) {
+	int cols = MAP_STRIDE;
+	int rows = MAP_PADDED_ROWS;
+	int offset = 0;
+	mapPyramidStride[0] = cols;
+	mapPyramidRows[0] = rows;
+	mapPyramidLevels = 0;
+
+	// stop once a single block covers the whole map; it always has walls
+	while ((cols > 1 || rows > 1) && mapPyramidLevels < MAP_MAX_PYRAMID_LEVELS) {
+		int level = ++mapPyramidLevels;
+		cols = (cols + 1) / 2;
+		rows = (rows + 1) / 2;
+		mapPyramidStride[level] = cols;
+		mapPyramidRows[level] = rows;
+		mapPyramidOffset[level] = offset;
+		offset += cols * rows;
+
+		for (int r = 0; r < rows; r++) {
+			for (int c = 0; c < cols; c++) {
+				updatePyramidBlock(level, c, r);
+			}
+		}
+	}
+}
+
+void initializeMap(void) {
+	// start with every cell solid so the border ends up as the sentinel
+	for (int i = 0; i < MAP_NUM_CELLS; i++) {
+		setCell(i, MAP_BORDER_CONTENT);
+	}
+	for (int r = 0; r < MAP_NUM_ROWS; r++) {
+		for (int c = 0; c < MAP_NUM_COLS; c++) {
+			setCell(mapCellIndex(c, r), levelLayout[r][c]);
+		}
+	}
+	computeDistanceField(0, 0, MAP_STRIDE - 1, MAP_PADDED_ROWS - 1);
+	buildPyramid();
+}
+
+void setMapTile(int col, int row, int content) {
+	if (col < 0 || col >= MAP_NUM_COLS || row < 0 || row >= MAP_NUM_ROWS) {
+		return;
+	}
+	int index = mapCellIndex(col, row);
+	mapVersion++;
+	if ((mapContent[index] != 0) == (content != 0)) {
+		mapContent[index] = (uint8_t)content;
+		return;
+	}
+	setCell(index, content);
+
+	for (int level = 1; level <= mapPyramidLevels; level++) {
+		updatePyramidBlock(level, (col + 1) >> level, (row + 1) >> level);
+	}
+
+	// only cells within MAP_MAX_DISTANCE of the tile can see a different nearest wall
+	computeDistanceField(
+		col + 1 - MAP_MAX_DISTANCE, row + 1 - MAP_MAX_DISTANCE,
+		col + 1 + MAP_MAX_DISTANCE, row + 1 + MAP_MAX_DISTANCE
+	);
+}
+
+int getMapTile(int col, int row) {
+	return mapContent[mapCellIndex(col, row)];
+}
+
+int mapHasWallAt(float x, float y) {
+	if (x < 0 || x >= MAP_NUM_COLS * TILE_SIZE || y < 0 || y >= MAP_NUM_ROWS * TILE_SIZE) {
+		return TRUE;
+	}
+	return mapIsWallAtIndex(mapCellIndex((int)(x / TILE_SIZE), (int)(y / TILE_SIZE)));
+}
+
+// Used for collision: one pyramid lookup answers for any area that fits in a
+// single empty block, only areas straddling walls are checked cell by cell
+int mapHasWallInArea(float minX, float minY, float maxX, float maxY) {
+	if (minX < 0 || maxX >= MAP_NUM_COLS * TILE_SIZE || minY < 0 || maxY >= MAP_NUM_ROWS * TILE_SIZE) {
+		return TRUE;
+	}
+	int minCol = (int)(minX / TILE_SIZE) + 1;
+	int minRow = (int)(minY / TILE_SIZE) + 1;
+	int maxCol = (int)(maxX / TILE_SIZE) + 1;
+	int maxRow = (int)(maxY / TILE_SIZE) + 1;
+
+	int level = 0;
+	while ((minCol >> level) != (maxCol >> level) || (minRow >> level) != (maxRow >> level)) {
+		level++;
+	}
+	if (level == 0) {
+		return mapHasWallAt(minX, minY);
+	}
+	if (level <= mapPyramidLevels && !mapBlockHasWall(level, minCol >> level, minRow >> level)) {
+		return FALSE;
+	}
+
+	for (int r = minRow; r <= maxRow; r++) {
+		for (int c = minCol; c <= maxCol; c++) {
+			if (mapIsWallAtIndex(r * MAP_STRIDE + c)) {
+				return TRUE;
+			}
+		}
+	}
+	return FALSE;
+}
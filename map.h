@@ -0,0 +1,64 @@
+#ifndef MAP_H
+#define MAP_H
+
+#include <stdint.h>
+#include "constants.h"
+
+// The grid is stored with a one-cell solid border around the playable area,
+// so a ray leaving the map always hits a wall and traversal never has to
+// bounds-check. Cells are addressed by a flat index into the padded grid;
+// stepping one cell in x is +-1, in y it is +-MAP_STRIDE.
+#define MAP_STRIDE (MAP_NUM_COLS + 2)
+#define MAP_PADDED_ROWS (MAP_NUM_ROWS + 2)
+#define MAP_NUM_CELLS (MAP_STRIDE * MAP_PADDED_ROWS)
+
+// Content reported for rays that hit the sentinel border
+#define MAP_BORDER_CONTENT 1
+
+// Distances in the distance field saturate at this many cells
+#define MAP_MAX_DISTANCE 255
+
+// Occupancy pyramid: level L has one bit per 2^L x 2^L block of padded cells,
+// set if any cell in the block is a wall. Level 0 is mapOccupancy itself.
+#define MAP_MAX_PYRAMID_LEVELS 16
+#define MAP_PYRAMID_BITS (MAP_NUM_CELLS / 3 + MAP_STRIDE + MAP_PADDED_ROWS + MAP_MAX_PYRAMID_LEVELS + 1)
+
+// One occupancy bit per cell, and the wall content of each cell
+extern uint32_t mapOccupancy[(MAP_NUM_CELLS + 31) / 32];
+extern uint8_t mapContent[MAP_NUM_CELLS];
+
+// Chebyshev distance in cells from each cell to the nearest wall (0 on walls),
+// so every cell closer than mapDistance[i] to cell i is known to be empty.
+// Padded by three bytes so it can be read with 32-bit gathers.
+extern uint8_t mapDistance[MAP_NUM_CELLS + 3];
+
+// Bumped whenever a tile changes, so caches of cast results can tell they are stale
+extern int mapVersion;
+
+// Levels 1..mapPyramidLevels of the occupancy pyramid, packed one after another
+extern uint32_t mapPyramid[(MAP_PYRAMID_BITS + 31) / 32];
+extern int mapPyramidLevels;
+extern int mapPyramidStride[MAP_MAX_PYRAMID_LEVELS + 1];
+extern int mapPyramidOffset[MAP_MAX_PYRAMID_LEVELS + 1];
+
+void initializeMap(void);
+void setMapTile(int col, int row, int content);
+int getMapTile(int col, int row);
+int mapHasWallAt(float x, float y);
+int mapHasWallInArea(float minX, float minY, float maxX, float maxY);
+
+static inline int mapCellIndex(int col, int row) {
+	return (row + 1) * MAP_STRIDE + (col + 1);
+}
+
+static inline int mapIsWallAtIndex(int index) {
+	return (mapOccupancy[index >> 5] >> (index & 31)) & 1;
+}
+
+// Block coordinates are padded cell coordinates shifted right by level
+static inline int mapBlockHasWall(int level, int blockCol, int blockRow) {
+	int bit = mapPyramidOffset[level] + blockRow * mapPyramidStride[level] + blockCol;
+	return (mapPyramid[bit >> 5] >> (bit & 31)) & 1;
+}
+
+#endif
@@ -0,0 +1,148 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <SDL.h>
+#include <SDL_bits.h>
+#include "constants.h"
+#include "profiler.h"
+#include "trace.h"
+
+// Number of most recent samples each phase's histogram covers
+#define PROFILE_WINDOW 1024
+
+// Histogram buckets are exact below 8 ns and then 8 per power of two, so each
+// bucket spans at most 12.5% of the times it holds, up to about 4 seconds
+#define PROFILE_SUB_BUCKETS 8
+#define PROFILE_BUCKETS (30 * PROFILE_SUB_BUCKETS)
+
+static const char* phaseNames[NUM_PROFILE_PHASES] = {
+	"processInput",
+	"movePlayer",
+	"castAllRays",
+	"renderWallProjection",
+	"renderFloorAndCeiling",
+	"renderSprites",
+	"renderMap",
+	"renderRays",
+	"renderPlayer",
+	"renderColorBuffer",
+	"SDL_RenderPresent"
+};
+
+struct PhaseProfile {
+	Uint64 start;
+	Uint32 samples[PROFILE_WINDOW]; // nanoseconds, oldest overwritten first
+	int histogram[PROFILE_BUCKETS];
+	int numSamples;
+	int nextSample;
+	Uint64 windowTotal;
+	Uint32 worst; // over the whole run, not just the window
+};
+
+static struct PhaseProfile phases[NUM_PROFILE_PHASES];
+static double nanosecondsPerTick;
+
+static int getBucket(Uint32 nanoseconds) {
+	if (nanoseconds < PROFILE_SUB_BUCKETS) {
+		return nanoseconds;
+	}
+	int exponent = SDL_MostSignificantBitIndex32(nanoseconds);
+	return (exponent - 2) * PROFILE_SUB_BUCKETS + ((nanoseconds >> (exponent - 3)) & (PROFILE_SUB_BUCKETS - 1));
+}
+
+// Smallest time that falls past the bucket
+static double getBucketLimit(int bucket) {
+	bucket++;
+	if (bucket < PROFILE_SUB_BUCKETS) {
+		return bucket;
+	}
+	int exponent = bucket / PROFILE_SUB_BUCKETS + 2;
+	return ldexp(PROFILE_SUB_BUCKETS + bucket % PROFILE_SUB_BUCKETS, exponent - 3);
+}
+
+void initializeProfiler(void) {
+	memset(phases, 0, sizeof(phases));
+	nanosecondsPerTick = 1e9 / SDL_GetPerformanceFrequency();
+}
+
+// Phases also show up as zones in the trace timeline
+void beginProfilePhase(int phase) {
+	TRACE_BEGIN(phaseNames[phase]);
+	phases[phase].start = SDL_GetPerformanceCounter();
+}
+
+void endProfilePhase(int phase) {
+	struct PhaseProfile* profile = &phases[phase];
+	double elapsed = (SDL_GetPerformanceCounter() - profile->start) * nanosecondsPerTick;
+	Uint32 nanoseconds = elapsed < 4e9 ? (Uint32)elapsed : 4000000000u;
+
+	if (profile->numSamples == PROFILE_WINDOW) {
+		Uint32 oldest = profile->samples[profile->nextSample];
+		profile->histogram[getBucket(oldest)]--;
+		profile->windowTotal -= oldest;
+	}
+	else {
+		profile->numSamples++;
+	}
+	profile->samples[profile->nextSample] = nanoseconds;
+	profile->nextSample = (profile->nextSample + 1) % PROFILE_WINDOW;
+	profile->histogram[getBucket(nanoseconds)]++;
+	profile->windowTotal += nanoseconds;
+	profile->worst = SDL_max(profile->worst, nanoseconds);
+	TRACE_END(phaseNames[phase]);
+}
+
+// Upper edge of the bucket holding the given fraction of the window, in milliseconds
+static double getPercentile(const struct PhaseProfile* profile, double fraction) {
+	int target = (int)ceil(fraction * profile->numSamples);
+	int count = 0;
+	for (int bucket = 0; bucket < PROFILE_BUCKETS; bucket++) {
+		count += profile->histogram[bucket];
+		if (count >= SDL_max(target, 1)) {
+			return getBucketLimit(bucket) / 1e6;
+		}
+	}
+	return 0;
+}
+
+int writeProfile(const char* path) {
+	FILE* file = fopen(path, "w");
+	if (file == NULL) {
+		fprintf(stderr, "Error writing the profile to %s.\n", path);
+		return FALSE;
+	}
+
+	size_t length = strlen(path);
+	int isJson = length >= 5 && strcmp(path + length - 5, ".json") == 0;
+	if (isJson) {
+		fprintf(file, "{\n\t\"windowFrames\": %d,\n\t\"phases\": [", PROFILE_WINDOW);
+	}
+	else {
+		fprintf(file, "phase,samples,mean_ms,p50_ms,p90_ms,p99_ms,max_ms\n");
+	}
+
+	for (int phase = 0; phase < NUM_PROFILE_PHASES; phase++) {
+		const struct PhaseProfile* profile = &phases[phase];
+		double mean = profile->numSamples > 0 ? (double)profile->windowTotal / profile->numSamples / 1e6 : 0;
+		double worst = profile->worst / 1e6;
+		// a bucket's upper edge can lie past the slowest sample it holds
+		double p50 = SDL_min(getPercentile(profile, 0.50), worst);
+		double p90 = SDL_min(getPercentile(profile, 0.90), worst);
+		double p99 = SDL_min(getPercentile(profile, 0.99), worst);
+		if (isJson) {
+			fprintf(file, "%s\n\t\t{ \"phase\": \"%s\", \"samples\": %d, \"meanMs\": %.4f, "
+				"\"p50Ms\": %.4f, \"p90Ms\": %.4f, \"p99Ms\": %.4f, \"maxMs\": %.4f }",
+				phase == 0 ? "" : ",", phaseNames[phase], profile->numSamples, mean, p50, p90, p99, worst);
+		}
+		else {
+			fprintf(file, "%s,%d,%.4f,%.4f,%.4f,%.4f,%.4f\n",
+				phaseNames[phase], profile->numSamples, mean, p50, p90, p99, worst);
+		}
+	}
+
+	if (isJson) {
+		fprintf(file, "\n\t]\n}\n");
+	}
+	fclose(file);
+	return TRUE;
+}
@@ -0,0 +1,29 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+// Frame stages timed by the profiler
+#define PROFILE_PROCESS_INPUT 0
+#define PROFILE_MOVE_PLAYER 1
+#define PROFILE_CAST_ALL_RAYS 2
+#define PROFILE_RENDER_WALLS 3
+#define PROFILE_RENDER_FLOOR 4
+#define PROFILE_RENDER_SPRITES 5
+#define PROFILE_RENDER_MAP 6
+#define PROFILE_RENDER_RAYS 7
+#define PROFILE_RENDER_PLAYER 8
+#define PROFILE_RENDER_COLOR_BUFFER 9
+#define PROFILE_RENDER_PRESENT 10
+#define NUM_PROFILE_PHASES 11
+
+// Times each phase on the performance counter and keeps a log-scale histogram
+// of its last PROFILE_WINDOW samples. A phase must begin and end on the same
+// thread, but different phases may run on different threads.
+void initializeProfiler(void);
+void beginProfilePhase(int phase);
+void endProfilePhase(int phase);
+
+// Writes per-phase percentiles over the rolling window, as JSON if the path
+// ends in .json and as CSV otherwise. Returns FALSE if the file can't be written.
+int writeProfile(const char* path);
+
+#endif
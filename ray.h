@@ -0,0 +1,28 @@
+#ifndef RAY_H
+#define RAY_H
+
+#include <stdint.h>
+#include "constants.h"
+
+// Bits of RayBuffer.flags
+#define RAY_FACING_UP (1 << 0)
+#define RAY_FACING_DOWN (1 << 1)
+#define RAY_FACING_LEFT (1 << 2)
+#define RAY_FACING_RIGHT (1 << 3)
+#define RAY_HIT_VERTICAL (1 << 4)
+
+// Cast results for one frame, one array per field so each consumer
+// only streams what it reads. Float arrays are cache-line aligned, so a ray
+// packet starting at a multiple of its width can use aligned vector stores.
+// Hit points are not stored: they are the camera plus the column's ray
+// direction times distance (getRayWallHit in main.c).
+struct RayBuffer {
+	CACHE_ALIGNED float distance[NUM_RAYS];
+	CACHE_ALIGNED uint8_t wallHitContent[NUM_RAYS];
+	CACHE_ALIGNED uint8_t flags[NUM_RAYS];
+};
+
+// The buffer the ray pass writes into; frames alternate between two of them
+extern struct RayBuffer* rays;
+
+#endif
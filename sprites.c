@@ -0,0 +1,54 @@
+#include <string.h>
+#include "sprites.h"
+#include "map.h"
+#include "textures.h"
+
+// Sprites keep at least this far from walls, so none is drawn half inside one
+#define SPRITE_WALL_CLEARANCE (TILE_SIZE / 4)
+
+struct Sprite sprites[NUM_SPRITES];
+
+void initializeSprites(void) {
+	// a fixed seed keeps the layout identical between runs and benchmarks
+	uint32_t seed = 12345;
+	int numPlaced = 0;
+	while (numPlaced < NUM_SPRITES) {
+		seed = seed * 1664525u + 1013904223u;
+		float x = (float)(seed >> 8 & 0xFFFF) / 0x10000 * MAP_NUM_COLS * TILE_SIZE;
+		seed = seed * 1664525u + 1013904223u;
+		float y = (float)(seed >> 8 & 0xFFFF) / 0x10000 * MAP_NUM_ROWS * TILE_SIZE;
+		if (mapHasWallInArea(x - SPRITE_WALL_CLEARANCE, y - SPRITE_WALL_CLEARANCE,
+			x + SPRITE_WALL_CLEARANCE, y + SPRITE_WALL_CLEARANCE)) {
+			continue;
+		}
+		sprites[numPlaced].x = x;
+		sprites[numPlaced].y = y;
+		sprites[numPlaced].texture = (seed >> 28) % NUM_SPRITE_TEXTURES;
+		numPlaced++;
+	}
+}
+
+void radixSortByKey(uint32_t* entries, uint32_t* scratch, int count) {
+	int counts[256];
+	uint32_t* source = entries;
+	uint32_t* destination = scratch;
+	for (int shift = 16; shift < 32; shift += 8) {
+		memset(counts, 0, sizeof(counts));
+		for (int i = 0; i < count; i++) {
+			counts[source[i] >> shift & 0xFF]++;
+		}
+		int offset = 0;
+		for (int digit = 0; digit < 256; digit++) {
+			int digitCount = counts[digit];
+			counts[digit] = offset;
+			offset += digitCount;
+		}
+		for (int i = 0; i < count; i++) {
+			destination[counts[source[i] >> shift & 0xFF]++] = source[i];
+		}
+		uint32_t* swap = source;
+		source = destination;
+		destination = swap;
+	}
+	// an even number of passes leaves the result back in entries
+}
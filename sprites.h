@@ -0,0 +1,24 @@
+#ifndef SPRITES_H
+#define SPRITES_H
+
+#include <stdint.h>
+#include "constants.h"
+
+// A billboard standing on the floor, always drawn facing the camera
+struct Sprite {
+	float x;
+	float y;
+	int texture; // index into spriteTextures
+};
+
+extern struct Sprite sprites[NUM_SPRITES];
+
+// Scatters the sprites over open floor, the same way every run
+void initializeSprites(void);
+
+// Sorts entries ascending by their top 16 bits with two 8-bit counting
+// passes; the low 16 bits (a sprite index) are carried along. The sort is
+// stable and scratch must have room for count entries.
+void radixSortByKey(uint32_t* entries, uint32_t* scratch, int count);
+
+#endif
@@ -0,0 +1,170 @@
+#include <math.h>
+#include <SDL.h>
+#include "textures.h"
+
+struct WallTexture wallTextures[NUM_WALL_TEXTURES];
+struct SpriteTexture spriteTextures[NUM_SPRITE_TEXTURES];
+
+static uint32_t hashTexel(int u, int v, int seed) {
+	uint32_t hash = (uint32_t)u * 73856093u ^ (uint32_t)v * 19349663u ^ (uint32_t)seed * 83492791u;
+	hash ^= hash >> 13;
+	hash *= 0x5bd1e995u;
+	hash ^= hash >> 15;
+	return hash;
+}
+
+static uint32_t makeColor(int red, int green, int blue) {
+	red = SDL_max(0, SDL_min(red, 255));
+	green = SDL_max(0, SDL_min(green, 255));
+	blue = SDL_max(0, SDL_min(blue, 255));
+	return 0xFF000000 | red << 16 | green << 8 | blue;
+}
+
+// Red bricks in a running bond with light mortar
+static uint32_t getBrickTexel(int u, int v) {
+	int offset = (v / 16) % 2 * 16;
+	int isMortar = v % 16 < 2 || (u + offset) % 32 < 2;
+	int noise = hashTexel(u, v, 1) % 24;
+	if (isMortar) {
+		return makeColor(150 + noise / 2, 150 + noise / 2, 140);
+	}
+	return makeColor(160 + noise, 50 + noise / 2, 40);
+}
+
+// Grey stone blocks with a highlight inside a dark seam
+static uint32_t getStoneTexel(int u, int v) {
+	int edge = SDL_min(SDL_min(u % 32, 31 - u % 32), SDL_min(v % 32, 31 - v % 32));
+	int shade = 110 + hashTexel(u, v, 2) % 30;
+	if (edge == 0) {
+		shade -= 40;
+	}
+	else if (edge == 1) {
+		shade += 25;
+	}
+	return makeColor(shade, shade, shade + 8);
+}
+
+// Vertical wooden planks with a wavy grain
+static uint32_t getWoodTexel(int u, int v) {
+	int plank = u / 16;
+	int grain = (int)(8 * sinf((v + plank * 23) * 0.35f + u * 0.8f));
+	int noise = hashTexel(u, v, 3) % 12;
+	if (u % 16 == 0) {
+		return makeColor(60, 35, 15);
+	}
+	return makeColor(140 + grain + noise, 90 + grain + noise / 2, 45 + grain / 2);
+}
+
+// Checkered blue glazed tiles with light grout
+static uint32_t getTileTexel(int u, int v) {
+	int isDark = (u / 16 + v / 16) % 2;
+	int noise = hashTexel(u, v, 4) % 16;
+	if (u % 16 == 0 || v % 16 == 0) {
+		return makeColor(200, 200, 190);
+	}
+	return makeColor(30 + noise, 70 + isDark * 30 + noise, 150 + isDark * 40);
+}
+
+static uint32_t (*const textureGenerators[NUM_WALL_TEXTURES])(int u, int v) = {
+	getBrickTexel,
+	getStoneTexel,
+	getWoodTexel,
+	getTileTexel
+};
+
+// Three quarters of each channel, the same for every texel of a shaded face
+static uint32_t shadeColor(uint32_t color) {
+	return 0xFF000000 | (((color >> 1) & 0x7F7F7F) + ((color >> 2) & 0x3F3F3F));
+}
+
+void createWallTextures(void) {
+	for (int i = 0; i < NUM_WALL_TEXTURES; i++) {
+		for (int u = 0; u < TEXTURE_WIDTH; u++) {
+			for (int v = 0; v < TEXTURE_HEIGHT; v++) {
+				uint32_t color = textureGenerators[i](u, v);
+				wallTextures[i].lit[u * TEXTURE_HEIGHT + v] = color;
+				wallTextures[i].shaded[u * TEXTURE_HEIGHT + v] = shadeColor(color);
+			}
+		}
+	}
+}
+
+#define TRANSPARENT 0x00000000
+
+// Wooden barrel standing on the floor, rounded by shading and bound with iron hoops
+static uint32_t getBarrelTexel(int u, int v) {
+	if (u < 18 || u >= 46 || v < 26) {
+		return TRANSPARENT;
+	}
+	int light = (int)(60 * cosf((u - 32) * (PI / 28)));
+	int noise = hashTexel(u, v, 5) % 12;
+	if (v < 29 || (v >= 40 && v < 42) || v >= 61) {
+		return makeColor(70 + light, 70 + light, 75 + light);
+	}
+	if ((u - 18) % 7 == 0) {
+		return makeColor(50 + light / 2, 30 + light / 2, 15);
+	}
+	return makeColor(110 + light + noise, 65 + light / 2 + noise, 30);
+}
+
+// Stone pillar from floor to ceiling with a wider capital and base
+static uint32_t getPillarTexel(int u, int v) {
+	int isEnd = v < 5 || v >= 59;
+	int halfWidth = isEnd ? 14 : 10;
+	if (u < 32 - halfWidth || u >= 32 + halfWidth) {
+		return TRANSPARENT;
+	}
+	int light = (int)(50 * cosf((u - 32) * (PI / (2 * halfWidth))));
+	int shade = 120 + light + hashTexel(u, v, 6) % 20;
+	if (v == 4 || v == 59) {
+		shade -= 40;
+	}
+	return makeColor(shade, shade - 5, shade - 15);
+}
+
+// Leafy plant in a clay pot
+static uint32_t getPlantTexel(int u, int v) {
+	if (v >= 50) {
+		int halfWidth = 8 - (v - 50) / 4;
+		if (u < 32 - halfWidth || u >= 32 + halfWidth) {
+			return TRANSPARENT;
+		}
+		return makeColor(170 - (v - 50) * 3, 80, 45);
+	}
+	int deltaX = u - 32;
+	int deltaY = v - 36;
+	int noise = hashTexel(u, v, 7) % 64;
+	if (deltaX * deltaX + deltaY * deltaY * 2 > 15 * 15 + noise) {
+		return TRANSPARENT;
+	}
+	int leaf = hashTexel(u / 3, v / 3, 8) % 60;
+	return makeColor(30 + leaf / 2, 100 + leaf, 35);
+}
+
+static uint32_t (*const spriteGenerators[NUM_SPRITE_TEXTURES])(int u, int v) = {
+	getBarrelTexel,
+	getPillarTexel,
+	getPlantTexel
+};
+
+void createSpriteTextures(void) {
+	for (int i = 0; i < NUM_SPRITE_TEXTURES; i++) {
+		struct SpriteTexture* texture = &spriteTextures[i];
+		texture->opaqueLeft = TEXTURE_WIDTH;
+		texture->opaqueRight = 0;
+		texture->opaqueTop = TEXTURE_HEIGHT;
+		texture->opaqueBottom = 0;
+		for (int u = 0; u < TEXTURE_WIDTH; u++) {
+			for (int v = 0; v < TEXTURE_HEIGHT; v++) {
+				uint32_t color = spriteGenerators[i](u, v);
+				texture->texels[u * TEXTURE_HEIGHT + v] = color;
+				if (color >> 24) {
+					texture->opaqueLeft = SDL_min(texture->opaqueLeft, u);
+					texture->opaqueRight = SDL_max(texture->opaqueRight, u + 1);
+					texture->opaqueTop = SDL_min(texture->opaqueTop, v);
+					texture->opaqueBottom = SDL_max(texture->opaqueBottom, v + 1);
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,45 @@
+#ifndef TEXTURES_H
+#define TEXTURES_H
+
+#include <stdint.h>
+#include "constants.h"
+
+// Both must be powers of two, texel rows are wrapped with a mask
+#define TEXTURE_WIDTH 64
+#define TEXTURE_HEIGHT 64
+
+#define NUM_WALL_TEXTURES 4
+#define NUM_SPRITE_TEXTURES 3
+
+// One set per wall content value: the lit variant for faces hit on vertical
+// grid lines and a pre-darkened one for horizontal faces. Texels are stored
+// column-major, column u is TEXTURE_HEIGHT contiguous texels starting at
+// u * TEXTURE_HEIGHT, so sampling down a wall strip reads sequential memory.
+struct WallTexture {
+	uint32_t lit[TEXTURE_WIDTH * TEXTURE_HEIGHT];
+	uint32_t shaded[TEXTURE_WIDTH * TEXTURE_HEIGHT];
+};
+
+// Sprite images, column-major like the walls. Texels with zero alpha are
+// transparent; the box around the opaque ones, in texels, lets the renderer
+// skip the empty margins of a sprite before testing any pixel.
+struct SpriteTexture {
+	uint32_t texels[TEXTURE_WIDTH * TEXTURE_HEIGHT];
+	int opaqueLeft; // columns [opaqueLeft, opaqueRight)
+	int opaqueRight;
+	int opaqueTop; // rows [opaqueTop, opaqueBottom)
+	int opaqueBottom;
+};
+
+extern struct WallTexture wallTextures[NUM_WALL_TEXTURES];
+extern struct SpriteTexture spriteTextures[NUM_SPRITE_TEXTURES];
+
+// Generate the textures; there are no image files to load
+void createWallTextures(void);
+void createSpriteTextures(void);
+
+static inline const struct WallTexture* getWallTexture(int content) {
+	return &wallTextures[(content - 1 + NUM_WALL_TEXTURES) % NUM_WALL_TEXTURES];
+}
+
+#endif
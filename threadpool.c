@@ -0,0 +1,202 @@
+#include <stdio.h>
+#include <SDL.h>
+#include "threadpool.h"
+#include "trace.h"
+
+#define MAX_POOL_THREADS 64
+#define CHUNKS_PER_THREAD 4
+
+// Threads that can have a job in the pool at the same time
+#define MAX_POOL_JOBS 4
+
+// A parallelFor in flight. Chunks are handed out under poolLock; the thread
+// that finishes the last one wakes the caller through done.
+struct PoolJob {
+	ThreadPoolJob function;
+	void* userData;
+	int count;
+	int chunkSize;
+	int numChunks;
+	int nextChunk;
+	int isActive;
+	SDL_atomic_t numFinished;
+	SDL_sem* done;
+};
+
+static SDL_Thread* workers[MAX_POOL_THREADS];
+static int numWorkers = 0;
+static int isShuttingDown = 0;
+
+static SDL_mutex* poolLock = NULL;
+static SDL_sem* workAvailable = NULL;
+static struct PoolJob jobs[MAX_POOL_JOBS];
+
+// Claims the next chunk of the given job, or of any job when job is NULL.
+// Returns the job the chunk belongs to, NULL when there is nothing left.
+static struct PoolJob* claimChunk(struct PoolJob* job, int* chunk) {
+	struct PoolJob* claimed = NULL;
+	SDL_LockMutex(poolLock);
+	for (int i = 0; i < MAX_POOL_JOBS && claimed == NULL; i++) {
+		struct PoolJob* candidate = job != NULL ? job : &jobs[i];
+		if (candidate->isActive && candidate->nextChunk < candidate->numChunks) {
+			*chunk = candidate->nextChunk++;
+			claimed = candidate;
+		}
+		if (job != NULL) {
+			break;
+		}
+	}
+	SDL_UnlockMutex(poolLock);
+	return claimed;
+}
+
+static void runChunk(struct PoolJob* job, int chunk) {
+	int begin = chunk * job->chunkSize;
+	int end = SDL_min(begin + job->chunkSize, job->count);
+	int numChunks = job->numChunks; // the slot may be reused once the last chunk is counted
+	job->function(begin, end, job->userData);
+	if (SDL_AtomicAdd(&job->numFinished, 1) + 1 == numChunks) {
+		SDL_SemPost(job->done);
+	}
+}
+
+static int workerMain(void* data) {
+	(void)data;
+	TRACE_THREAD_NAME("raycast worker");
+	for (;;) {
+		SDL_SemWait(workAvailable);
+		if (isShuttingDown) {
+			break;
+		}
+		// a wakeup may find its job already drained by the others, that is fine
+		struct PoolJob* job;
+		int chunk;
+		while ((job = claimChunk(NULL, &chunk)) != NULL) {
+			runChunk(job, chunk);
+		}
+	}
+	return 0;
+}
+
+int createThreadPool(int numThreads) {
+	if (numThreads <= 0) {
+		numThreads = SDL_GetCPUCount();
+	}
+	numThreads = SDL_max(1, SDL_min(numThreads, MAX_POOL_THREADS));
+
+	numWorkers = 0;
+	isShuttingDown = 0;
+	if (numThreads == 1) {
+		return 1;
+	}
+
+	poolLock = SDL_CreateMutex();
+	workAvailable = SDL_CreateSemaphore(0);
+	int hasSemaphores = poolLock != NULL && workAvailable != NULL;
+	for (int i = 0; i < MAX_POOL_JOBS; i++) {
+		jobs[i].isActive = 0;
+		jobs[i].done = SDL_CreateSemaphore(0);
+		hasSemaphores = hasSemaphores && jobs[i].done != NULL;
+	}
+	if (!hasSemaphores) {
+		fprintf(stderr, "Error creating thread pool semaphores.\n");
+		destroyThreadPool();
+		return 0;
+	}
+
+	for (int i = 0; i < numThreads - 1; i++) {
+		workers[i] = SDL_CreateThread(workerMain, "RaycastWorker", NULL);
+		if (!workers[i]) {
+			// keep running with however many workers we managed to start
+			fprintf(stderr, "Error creating worker thread: %s\n", SDL_GetError());
+			break;
+		}
+		numWorkers++;
+	}
+	return 1;
+}
+
+void destroyThreadPool(void) {
+	isShuttingDown = 1;
+	for (int i = 0; i < numWorkers; i++) {
+		SDL_SemPost(workAvailable);
+	}
+	for (int i = 0; i < numWorkers; i++) {
+		SDL_WaitThread(workers[i], NULL);
+	}
+	numWorkers = 0;
+
+	for (int i = 0; i < MAX_POOL_JOBS; i++) {
+		if (jobs[i].done) {
+			SDL_DestroySemaphore(jobs[i].done);
+			jobs[i].done = NULL;
+		}
+	}
+	if (workAvailable) {
+		SDL_DestroySemaphore(workAvailable);
+		workAvailable = NULL;
+	}
+	if (poolLock) {
+		SDL_DestroyMutex(poolLock);
+		poolLock = NULL;
+	}
+}
+
+int getThreadPoolSize(void) {
+	return numWorkers + 1;
+}
+
+void parallelFor(ThreadPoolJob job, int count, int chunkAlignment, void* userData) {
+	if (count <= 0) {
+		return;
+	}
+	if (numWorkers == 0) {
+		job(0, count, userData);
+		return;
+	}
+
+	// More chunks than threads so faster threads can pick up the slack,
+	// each rounded up to the requested alignment
+	int numChunks = getThreadPoolSize() * CHUNKS_PER_THREAD;
+	int chunkSize = (count + numChunks - 1) / numChunks;
+	if (chunkAlignment > 1) {
+		chunkSize = (chunkSize + chunkAlignment - 1) / chunkAlignment * chunkAlignment;
+	}
+
+	// jobs from different threads (the simulation casting while the main
+	// thread draws) share the workers chunk by chunk
+	struct PoolJob* poolJob = NULL;
+	SDL_LockMutex(poolLock);
+	for (int i = 0; i < MAX_POOL_JOBS && poolJob == NULL; i++) {
+		if (!jobs[i].isActive) {
+			poolJob = &jobs[i];
+			poolJob->function = job;
+			poolJob->userData = userData;
+			poolJob->count = count;
+			poolJob->chunkSize = chunkSize;
+			poolJob->numChunks = (count + chunkSize - 1) / chunkSize;
+			poolJob->nextChunk = 0;
+			SDL_AtomicSet(&poolJob->numFinished, 0);
+			poolJob->isActive = 1;
+		}
+	}
+	SDL_UnlockMutex(poolLock);
+	if (poolJob == NULL) {
+		// more callers than job slots, this one goes it alone
+		job(0, count, userData);
+		return;
+	}
+
+	for (int i = 0; i < SDL_min(numWorkers, poolJob->numChunks - 1); i++) {
+		SDL_SemPost(workAvailable);
+	}
+	int chunk;
+	while (claimChunk(poolJob, &chunk) != NULL) {
+		runChunk(poolJob, chunk);
+	}
+	SDL_SemWait(poolJob->done);
+
+	SDL_LockMutex(poolLock);
+	poolJob->isActive = 0;
+	SDL_UnlockMutex(poolLock);
+}
@@ -0,0 +1,19 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+// Work function run by the pool on the index range [begin, end)
+typedef void (*ThreadPoolJob)(int begin, int end, void* userData);
+
+// Starts numThreads - 1 persistent workers; the calling thread is the last one.
+// numThreads <= 0 uses one thread per CPU core, 1 runs every job serially.
+int createThreadPool(int numThreads);
+void destroyThreadPool(void);
+int getThreadPoolSize(void);
+
+// Splits [0, count) into chunks whose boundaries are multiples of
+// chunkAlignment and returns once every chunk has been processed. Safe to call
+// from several threads at once: the workers take chunks from every job in
+// flight, and each caller works on its own job until it is done.
+void parallelFor(ThreadPoolJob job, int count, int chunkAlignment, void* userData);
+
+#endif
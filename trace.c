@@ -0,0 +1,202 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <SDL.h>
+#include "trace.h"
+
+#if ENABLE_TRACING
+
+#if defined(_MSC_VER)
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL __thread
+#endif
+
+// Events a thread can hold between flushes, must be a power of two
+#define TRACE_BUFFER_EVENTS 16384
+#define MAX_TRACE_THREADS 80
+
+// The writer thread drains the buffers this often, or as soon as one of them
+// is half full
+#define TRACE_FLUSH_INTERVAL_MS 250
+
+struct TraceEvent {
+	Uint64 time;
+	const char* name;
+	char phase; // 'B' or 'E'
+};
+
+// Single producer, single consumer: only the owning thread advances head and
+// only the flushing thread advances tail
+struct TraceBuffer {
+	struct TraceEvent events[TRACE_BUFFER_EVENTS];
+	SDL_atomic_t head;
+	SDL_atomic_t tail;
+	const char* threadName;
+	int isNameWritten;
+};
+
+static struct TraceBuffer* traceBuffers[MAX_TRACE_THREADS];
+static SDL_atomic_t numTraceBuffers;
+static SDL_atomic_t numDroppedEvents;
+
+static THREAD_LOCAL struct TraceBuffer* threadBuffer;
+static THREAD_LOCAL const char* threadName;
+static THREAD_LOCAL int isThreadUntraced;
+
+static FILE* traceFile = NULL;
+static int isTracing = FALSE;
+static SDL_Thread* writerThread = NULL;
+static SDL_sem* writerWake = NULL;
+static SDL_atomic_t isWriterStopping;
+static int numWrittenEvents;
+static Uint64 traceStartTime;
+static double microsecondsPerTick;
+
+// The calling thread's buffer, created on its first event
+static struct TraceBuffer* getThreadBuffer(void) {
+	if (threadBuffer != NULL || isThreadUntraced) {
+		return threadBuffer;
+	}
+	int index = SDL_AtomicAdd(&numTraceBuffers, 1);
+	struct TraceBuffer* buffer = index < MAX_TRACE_THREADS ? calloc(1, sizeof(struct TraceBuffer)) : NULL;
+	if (buffer == NULL) {
+		isThreadUntraced = TRUE;
+		return NULL;
+	}
+	buffer->threadName = threadName != NULL ? threadName : "thread";
+	SDL_AtomicSetPtr((void**)&traceBuffers[index], buffer);
+	threadBuffer = buffer;
+	return buffer;
+}
+
+static void recordTraceEvent(const char* name, char phase) {
+	if (!isTracing) {
+		return;
+	}
+	struct TraceBuffer* buffer = getThreadBuffer();
+	if (buffer == NULL) {
+		return;
+	}
+	int head = SDL_AtomicGet(&buffer->head);
+	if (head - SDL_AtomicGet(&buffer->tail) >= TRACE_BUFFER_EVENTS) {
+		SDL_AtomicIncRef(&numDroppedEvents);
+		return;
+	}
+	struct TraceEvent* event = &buffer->events[head & (TRACE_BUFFER_EVENTS - 1)];
+	event->time = SDL_GetPerformanceCounter();
+	event->name = name;
+	event->phase = phase;
+	// hands the event to the writer thread
+	SDL_AtomicSet(&buffer->head, head + 1);
+	if (head + 1 - SDL_AtomicGet(&buffer->tail) == TRACE_BUFFER_EVENTS / 2) {
+		SDL_SemPost(writerWake);
+	}
+}
+
+void traceBegin(const char* name) {
+	recordTraceEvent(name, 'B');
+}
+
+void traceEnd(const char* name) {
+	recordTraceEvent(name, 'E');
+}
+
+void nameTraceThread(const char* name) {
+	threadName = name;
+	if (threadBuffer != NULL) {
+		threadBuffer->threadName = name;
+	}
+}
+
+// Writes out everything recorded since the last flush; only the writer
+// thread calls it, and stopTrace once the writer has exited
+static void flushTrace(void) {
+	int numBuffers = SDL_min(SDL_AtomicGet(&numTraceBuffers), MAX_TRACE_THREADS);
+	for (int i = 0; i < numBuffers; i++) {
+		struct TraceBuffer* buffer = SDL_AtomicGetPtr((void**)&traceBuffers[i]);
+		if (buffer == NULL) {
+			continue;
+		}
+		if (!buffer->isNameWritten) {
+			fprintf(traceFile, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+				numWrittenEvents++ > 0 ? "," : "", i, buffer->threadName);
+			buffer->isNameWritten = TRUE;
+		}
+
+		int head = SDL_AtomicGet(&buffer->head);
+		int tail = SDL_AtomicGet(&buffer->tail);
+		for (; tail != head; tail++) {
+			const struct TraceEvent* event = &buffer->events[tail & (TRACE_BUFFER_EVENTS - 1)];
+			fprintf(traceFile, "%s\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":%d}",
+				numWrittenEvents++ > 0 ? "," : "", event->name, event->phase,
+				(double)(event->time - traceStartTime) * microsecondsPerTick, i);
+		}
+		// frees the slots for the owning thread
+		SDL_AtomicSet(&buffer->tail, tail);
+	}
+}
+
+// Formats and writes the events on its own thread, so the threads being
+// traced only ever store into their rings
+static int runTraceWriter(void* data) {
+	(void)data;
+	while (!SDL_AtomicGet(&isWriterStopping)) {
+		SDL_SemWaitTimeout(writerWake, TRACE_FLUSH_INTERVAL_MS);
+		flushTrace();
+	}
+	return 0;
+}
+
+int startTrace(const char* path) {
+	traceFile = fopen(path, "w");
+	if (traceFile == NULL) {
+		fprintf(stderr, "Error opening the trace file %s.\n", path);
+		return FALSE;
+	}
+	fprintf(traceFile, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+	numWrittenEvents = 0;
+	traceStartTime = SDL_GetPerformanceCounter();
+	microsecondsPerTick = 1e6 / SDL_GetPerformanceFrequency();
+
+	writerWake = SDL_CreateSemaphore(0);
+	SDL_AtomicSet(&isWriterStopping, FALSE);
+	writerThread = writerWake != NULL ? SDL_CreateThread(runTraceWriter, "TraceWriter", NULL) : NULL;
+	if (writerThread == NULL) {
+		fprintf(stderr, "Error starting the trace writer thread.\n");
+		if (writerWake != NULL) {
+			SDL_DestroySemaphore(writerWake);
+			writerWake = NULL;
+		}
+		fclose(traceFile);
+		traceFile = NULL;
+		return FALSE;
+	}
+	isTracing = TRUE;
+	return TRUE;
+}
+
+void stopTrace(void) {
+	if (!isTracing) {
+		return;
+	}
+	// no new events after this; the writer drains what it can see, then the
+	// last flush here picks up anything recorded while it was finishing
+	isTracing = FALSE;
+	SDL_AtomicSet(&isWriterStopping, TRUE);
+	SDL_SemPost(writerWake);
+	SDL_WaitThread(writerThread, NULL);
+	writerThread = NULL;
+	SDL_DestroySemaphore(writerWake);
+	writerWake = NULL;
+	flushTrace();
+	fprintf(traceFile, "\n]}\n");
+	fclose(traceFile);
+	traceFile = NULL;
+
+	int numDropped = SDL_AtomicGet(&numDroppedEvents);
+	if (numDropped > 0) {
+		fprintf(stderr, "Trace dropped %d events on full buffers.\n", numDropped);
+	}
+}
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "constants.h"
+
+// Timeline tracing in Chrome trace_event JSON, for chrome://tracing or
+// Perfetto. Each thread records begin/end events into its own lock-free ring
+// buffer; a writer thread started by TRACE_START formats and writes them out
+// in the background. TRACE_STOP must run once the traced threads are idle.
+// With ENABLE_TRACING off every macro below compiles to nothing.
+#if ENABLE_TRACING
+
+int startTrace(const char* path);
+void stopTrace(void);
+void nameTraceThread(const char* name);
+void traceBegin(const char* name);
+void traceEnd(const char* name);
+
+#define TRACE_START(path) startTrace(path)
+#define TRACE_STOP() stopTrace()
+#define TRACE_THREAD_NAME(name) nameTraceThread(name)
+#define TRACE_BEGIN(name) traceBegin(name)
+#define TRACE_END(name) traceEnd(name)
+
+#else
+
+#define TRACE_START(path) FALSE
+#define TRACE_STOP() ((void)0)
+#define TRACE_THREAD_NAME(name) ((void)0)
+#define TRACE_BEGIN(name) ((void)0)
+#define TRACE_END(name) ((void)0)
+
+#endif
+
+#endif